@@ -0,0 +1,272 @@
+#include "dist_util.h"
+#include "dpdk_util.h"
+
+// Flow popularity model
+static int flow_dist_model = FLOW_DIST_UNIFORM;
+static double zipf_exponent;
+static double hotset_fraction;
+static double hotset_probability;
+static char flow_weights_file[128];
+
+// Derive an independent non-zero PRNG state for each stream (splitmix64)
+uint64_t rng_seed(uint64_t seed, uint64_t stream) {
+	uint64_t z = seed + (stream + 1) * 0x9E3779B97F4A7C15ULL;
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	z = z ^ (z >> 31);
+
+	return z ? z : 0x9E3779B97F4A7C15ULL;
+}
+
+// Sample the value using Exponential Distribution
+double sample(double lambda, uint64_t *rng) {
+	double u = ((double) rng_next(rng)) / ((uint64_t) -1);
+
+	return -log(1 - u) / lambda;
+}
+
+// Append n gaps to the ring of the generator
+void refill_interarrival(interarrival_gen_t *gen, uint32_t n) {
+	uint64_t tail = gen->tail;
+	if(gen->distribution == UNIFORM_VALUE) {
+		for(uint32_t j = 0; j < n; j++) {
+			gen->gaps[(tail++) & INTERARRIVAL_RING_MASK] = gen->lambda * TICKS_PER_US;
+		}
+	} else {
+		for(uint32_t j = 0; j < n; j++) {
+			gen->gaps[(tail++) & INTERARRIVAL_RING_MASK] = sample(gen->lambda, &gen->rng) * TICKS_PER_US;
+		}
+	}
+	gen->tail = tail;
+}
+
+// Parameter of the distribution for the rate of a queue (gap in us if uniform, packets per us if exponential)
+static double interarrival_lambda(int distribution, uint64_t rate_per_queue) {
+	if(distribution == UNIFORM_VALUE) {
+		return (1.0/rate_per_queue) * 1000000.0;
+	} else if(distribution == EXPONENTIAL_VALUE) {
+		return 1.0/(1000000.0/rate_per_queue);
+	}
+
+	rte_exit(EXIT_FAILURE, "Cannot define the interarrival distribution.\n");
+}
+
+// Allocate and fill one interarrival generator per queue for the rate specified
+void create_interarrival_gens(int distribution, uint64_t rate) {
+	double lambda = interarrival_lambda(distribution, rate/nr_queues);
+
+	for(uint64_t i = 0; i < nr_queues; i++) {
+		interarrival_gen_t *gen = (interarrival_gen_t*) rte_zmalloc_socket("interarrival_gen", sizeof(interarrival_gen_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+		if(gen == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot alloc the interarrival generator.\n");
+		}
+
+		gen->rng = rng_seed(SEED, i);
+		gen->lambda = lambda;
+		gen->distribution = distribution;
+
+		// fill the whole ring and measure the cost of a refill
+		uint64_t t0 = rte_rdtsc_precise();
+		refill_interarrival(gen, INTERARRIVAL_RING_SIZE);
+		gen->refill_cost = ((rte_rdtsc_precise() - t0) * INTERARRIVAL_REFILL_SIZE)/INTERARRIVAL_RING_SIZE;
+
+		interarrival_gens[i] = gen;
+	}
+}
+
+// Switch the generator to another distribution and rate (the idle refills fill the rest of the ring)
+void reset_interarrival_gen(interarrival_gen_t *gen, int distribution, uint64_t rate) {
+	gen->lambda = interarrival_lambda(distribution, rate/nr_queues);
+	gen->distribution = distribution;
+	gen->head = gen->tail;
+	refill_interarrival(gen, INTERARRIVAL_REFILL_SIZE);
+}
+
+// Parse the flow popularity model: uniform, zipf:S, hotset:FRACTION:PROBABILITY or file:FILENAME
+int parse_flow_dist(const char *spec) {
+	if(strcmp(spec, "uniform") == 0) {
+		flow_dist_model = FLOW_DIST_UNIFORM;
+	} else if(sscanf(spec, "zipf:%lf", &zipf_exponent) == 1) {
+		flow_dist_model = FLOW_DIST_ZIPF;
+	} else if(sscanf(spec, "hotset:%lf:%lf", &hotset_fraction, &hotset_probability) == 2) {
+		if(hotset_fraction <= 0 || hotset_fraction >= 1 || hotset_probability < 0 || hotset_probability > 1) {
+			return -1;
+		}
+		flow_dist_model = FLOW_DIST_HOTSET;
+	} else if(strncmp(spec, "file:", 5) == 0 && strlen(spec) > 5) {
+		snprintf(flow_weights_file, sizeof(flow_weights_file), "%s", spec + 5);
+		flow_dist_model = FLOW_DIST_FILE;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Load one weight per line (line i is the weight of the flow i)
+static double *load_flow_weights() {
+	FILE *fp = fopen(flow_weights_file, "r");
+	if(fp == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot open the flow weights file %s.\n", flow_weights_file);
+	}
+
+	double *weights = (double*) malloc(nr_flows * sizeof(double));
+	if(weights == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the flow weights array.\n");
+	}
+
+	for(uint64_t i = 0; i < nr_flows; i++) {
+		if(fscanf(fp, "%lf", &weights[i]) != 1 || weights[i] < 0) {
+			rte_exit(EXIT_FAILURE, "Invalid or missing weight for the flow %lu in %s.\n", i, flow_weights_file);
+		}
+	}
+
+	fclose(fp);
+
+	return weights;
+}
+
+// Weight of a flow under the selected popularity model (flow 0 is the most popular)
+static double flow_weight(uint64_t flow, const double *file_weights) {
+	uint64_t nr_hot;
+
+	switch(flow_dist_model) {
+	case FLOW_DIST_ZIPF:
+		return 1.0/pow(flow + 1, zipf_exponent);
+
+	case FLOW_DIST_HOTSET:
+		nr_hot = RTE_MAX(1, (uint64_t) (hotset_fraction * nr_flows));
+		if(nr_hot >= nr_flows) {
+			return 1.0;
+		}
+		return (flow < nr_hot) ? hotset_probability/nr_hot : (1.0 - hotset_probability)/(nr_flows - nr_hot);
+
+	case FLOW_DIST_FILE:
+		return file_weights[flow];
+
+	default:
+		return 1.0;
+	}
+}
+
+// Build the alias table of the flows with the given weights (Vose's method)
+void build_alias_table(flow_dist_t *dist, const uint32_t *flows, const double *weights, uint32_t n, int socket_id) {
+	double total = 0;
+	for(uint32_t i = 0; i < n; i++) {
+		total += weights[i];
+	}
+	if(total <= 0) {
+		rte_exit(EXIT_FAILURE, "Every flow of a queue has zero weight.\n");
+	}
+
+	double *scaled = (double*) malloc(n * sizeof(double));
+	uint32_t *small = (uint32_t*) malloc(n * sizeof(uint32_t));
+	uint32_t *large = (uint32_t*) malloc(n * sizeof(uint32_t));
+	dist->entries = (alias_entry_t*) rte_zmalloc_socket("alias_table", n * sizeof(alias_entry_t), RTE_CACHE_LINE_SIZE, socket_id);
+	if(scaled == NULL || small == NULL || large == NULL || dist->entries == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the alias table.\n");
+	}
+	dist->nr_entries = n;
+
+	// split the slots into under and over full
+	uint32_t nr_small = 0, nr_large = 0;
+	for(uint32_t i = 0; i < n; i++) {
+		scaled[i] = (weights[i] * n)/total;
+		if(scaled[i] < 1.0) {
+			small[nr_small++] = i;
+		} else {
+			large[nr_large++] = i;
+		}
+	}
+
+	// fill each under full slot with an over full one
+	while(nr_small > 0 && nr_large > 0) {
+		uint32_t s = small[--nr_small];
+		uint32_t l = large[--nr_large];
+
+		dist->entries[s].threshold = (uint32_t) (scaled[s] * 4294967296.0);
+		dist->entries[s].flow = flows[s];
+		dist->entries[s].alias = flows[l];
+
+		scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+		if(scaled[l] < 1.0) {
+			small[nr_small++] = l;
+		} else {
+			large[nr_large++] = l;
+		}
+	}
+
+	// the remaining slots are full (up to rounding errors)
+	while(nr_large > 0) {
+		uint32_t l = large[--nr_large];
+		dist->entries[l].threshold = UINT32_MAX;
+		dist->entries[l].flow = dist->entries[l].alias = flows[l];
+	}
+	while(nr_small > 0) {
+		uint32_t s = small[--nr_small];
+		dist->entries[s].threshold = UINT32_MAX;
+		dist->entries[s].flow = dist->entries[s].alias = flows[s];
+	}
+
+	free(scaled);
+	free(small);
+	free(large);
+}
+
+// Create a sampler of the items 0..n-1 with the given weights (the alias table returns the item)
+flow_dist_t *create_alias_sampler(const double *weights, uint32_t n, uint64_t stream, int socket_id) {
+	flow_dist_t *dist = (flow_dist_t*) rte_zmalloc_socket("alias_sampler", sizeof(flow_dist_t), RTE_CACHE_LINE_SIZE, socket_id);
+	uint32_t *items = (uint32_t*) malloc(n * sizeof(uint32_t));
+	if(dist == NULL || items == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the alias sampler.\n");
+	}
+
+	for(uint32_t i = 0; i < n; i++) {
+		items[i] = i;
+	}
+
+	dist->rng = rng_seed(SEED, stream);
+	build_alias_table(dist, items, weights, n, socket_id);
+	free(items);
+
+	return dist;
+}
+
+// Create one flow sampler per queue over the flows steered to that queue
+void create_flow_dists() {
+	double *file_weights = NULL;
+	if(flow_dist_model == FLOW_DIST_FILE) {
+		file_weights = load_flow_weights();
+	}
+
+	uint32_t max_flows_per_queue = (nr_flows + nr_queues - 1)/nr_queues;
+	uint32_t *flows = (uint32_t*) malloc(max_flows_per_queue * sizeof(uint32_t));
+	double *weights = (double*) malloc(max_flows_per_queue * sizeof(double));
+	if(flows == NULL || weights == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the flow_dist arrays.\n");
+	}
+
+	for(uint64_t i = 0; i < nr_queues; i++) {
+		flow_dist_t *dist = (flow_dist_t*) rte_zmalloc_socket("flow_dist", sizeof(flow_dist_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+		if(dist == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot alloc the flow_dist.\n");
+		}
+
+		// the flow f is steered back to the queue (f % nr_queues)
+		uint32_t n = 0;
+		for(uint64_t f = i; f < nr_flows; f += nr_queues) {
+			flows[n] = f;
+			weights[n] = flow_weight(f, file_weights);
+			n++;
+		}
+
+		dist->rng = rng_seed(SEED, RTE_MAX_LCORE + i);
+		build_alias_table(dist, flows, weights, n, queue_socket(i));
+
+		flow_dists[i] = dist;
+	}
+
+	free(flows);
+	free(weights);
+	free(file_weights);
+}
@@ -0,0 +1,111 @@
+#ifndef __DIST_UTIL_H__
+#define __DIST_UTIL_H__
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_malloc.h>
+#include <rte_branch_prediction.h>
+
+#define UNIFORM_VALUE					0
+#define EXPONENTIAL_VALUE				1
+
+#define FLOW_DIST_UNIFORM				0
+#define FLOW_DIST_ZIPF					1
+#define FLOW_DIST_HOTSET				2
+#define FLOW_DIST_FILE					3
+
+#define INTERARRIVAL_RING_SIZE			4096
+#define INTERARRIVAL_RING_MASK			(INTERARRIVAL_RING_SIZE - 1)
+#define INTERARRIVAL_REFILL_SIZE		32
+
+// Streaming interarrival generator (one per TX queue)
+typedef struct interarrival_gen_s {
+	// ring of gaps (in ticks) consumed by the TX
+	uint64_t						head;
+	uint64_t						tail;
+
+	// distribution parameters
+	uint64_t						rng;
+	double							lambda;
+	uint32_t						distribution;
+
+	// cycles spent to refill INTERARRIVAL_REFILL_SIZE gaps
+	uint64_t						refill_cost;
+
+	uint64_t						gaps[INTERARRIVAL_RING_SIZE];
+} __rte_cache_aligned interarrival_gen_t;
+
+// Alias table entry: slot flow if the coin is below the threshold, alias flow otherwise
+typedef struct alias_entry_s {
+	uint32_t						threshold;
+	uint32_t						flow;
+	uint32_t						alias;
+} alias_entry_t;
+
+// Flow popularity sampler (one per TX queue, over the flows owned by the queue)
+typedef struct flow_dist_s {
+	uint64_t						rng;
+	uint32_t						nr_entries;
+	alias_entry_t					*entries;
+} __rte_cache_aligned flow_dist_t;
+
+extern uint64_t nr_flows;
+extern uint64_t nr_queues;
+extern uint64_t TICKS_PER_US;
+extern interarrival_gen_t *interarrival_gens[RTE_MAX_LCORE];
+extern flow_dist_t *flow_dists[RTE_MAX_LCORE];
+
+uint64_t rng_seed(uint64_t seed, uint64_t stream);
+double sample(double lambda, uint64_t *rng);
+void create_interarrival_gens(int distribution, uint64_t rate);
+void reset_interarrival_gen(interarrival_gen_t *gen, int distribution, uint64_t rate);
+void refill_interarrival(interarrival_gen_t *gen, uint32_t n);
+int parse_flow_dist(const char *spec);
+void create_flow_dists();
+void build_alias_table(flow_dist_t *dist, const uint32_t *flows, const double *weights, uint32_t n, int socket_id);
+flow_dist_t *create_alias_sampler(const double *weights, uint32_t n, uint64_t stream, int socket_id);
+
+// Generate a uniform 64-bit random number (xorshift64*)
+static inline uint64_t rng_next(uint64_t *rng) {
+	uint64_t x = *rng;
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*rng = x;
+
+	return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Retrieve the next interarrival gap (in ticks)
+static inline uint64_t next_interarrival(interarrival_gen_t *gen) {
+	// refill in place only if the idle refills did not keep up
+	if(unlikely(gen->head == gen->tail)) {
+		refill_interarrival(gen, INTERARRIVAL_REFILL_SIZE);
+	}
+
+	return gen->gaps[(gen->head++) & INTERARRIVAL_RING_MASK];
+}
+
+// Refill the ring while waiting for the deadline, if there is enough slack
+static inline void refill_interarrival_idle(interarrival_gen_t *gen, uint64_t now, uint64_t deadline) {
+	if((now + gen->refill_cost < deadline) && (INTERARRIVAL_RING_SIZE - (gen->tail - gen->head) >= INTERARRIVAL_REFILL_SIZE)) {
+		refill_interarrival(gen, INTERARRIVAL_REFILL_SIZE);
+	}
+}
+
+// Choose the flow of the next packet in O(1)
+static inline uint32_t next_flow(flow_dist_t *dist) {
+	uint64_t r = rng_next(&dist->rng);
+	alias_entry_t *entry = &dist->entries[((r >> 32) * dist->nr_entries) >> 32];
+
+	return ((uint32_t) r < entry->threshold) ? entry->flow : entry->alias;
+}
+
+#endif // __DIST_UTIL_H__
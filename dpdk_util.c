@@ -1,7 +1,44 @@
 #include "dpdk_util.h"
 
+// Template/async rte_flow API (enabled for the ports that could be configured for it)
+static uint8_t flow_async[RTE_MAX_ETHPORTS];
+static uint32_t flow_queue_size[RTE_MAX_ETHPORTS];
+
+// Number of mbufs of a pool: the packets held by the NIC and the cores, plus the caches of the cores using it
+static uint32_t pool_elements(uint32_t nr_held, uint32_t nr_lcores) {
+	return nr_held + BURST_SIZE + nr_lcores * ((3 * MEMPOOL_CACHE_SIZE)/2);
+}
+
+// Number of mbufs of the RX pool of a queue (the RX descriptors and the backlog of the RX ring)
+static uint32_t rx_pool_elements(port_t *port) {
+	if(rx_rtc_mode) {
+		return pool_elements(port->nb_rxd, 1);
+	}
+
+	return pool_elements(port->nb_rxd + RX_RING_BACKLOG, 2);
+}
+
+// Number of mbufs of the TX pool of a queue (the TX descriptors and the burst being filled)
+static uint32_t tx_pool_elements(port_t *port) {
+	return pool_elements(port->nb_txd + BURST_SIZE, 1);
+}
+
+// Create the RX packet pool of each queue of the port
+static void create_rx_mempools(port_t *port, uint32_t data_room) {
+	char s[64];
+	uint32_t first_qid = (port - ports) * nr_queues_per_port;
+	for(uint32_t q = first_qid; q < first_qid + nr_queues_per_port; q++) {
+		snprintf(s, sizeof(s), "mbuf_pool%u", q);
+		pktmbuf_pools[q] = rte_pktmbuf_pool_create(s, rx_pool_elements(port), MEMPOOL_CACHE_SIZE, 0, data_room, port->socket_id);
+
+		if(pktmbuf_pools[q] == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot init mbuf pool on socket %d\n", port->socket_id);
+		}
+	}
+}
+
 // Initialize DPDK configuration
-void init_DPDK(uint16_t portid, uint64_t nr_queues) {
+void init_DPDK() {
 	// check the number of DPDK logical cores
 	if(rte_lcore_count() < min_lcores) {
 		rte_exit(EXIT_FAILURE, "No available worker cores!\n");
@@ -13,30 +50,168 @@ void init_DPDK(uint16_t portid, uint64_t nr_queues) {
 	// get the number of cycles per us
 	TICKS_PER_US = rte_get_timer_hz() / 1000000;
 
-	// flush all flows of the NIC
-	struct rte_flow_error error;
-	rte_flow_flush(portid, &error);
+	// initialize the DPDK ports (with the same number of queues)
+	uint16_t nb_rx_queue = nr_queues_per_port;
+	uint16_t nb_tx_queue = nr_queues_per_port;
 
-	// allocate the packet pool
-	char s[64];
-	snprintf(s, sizeof(s), "mbuf_pool");
-	pktmbuf_pool = rte_pktmbuf_pool_create(s, PKTMBUF_POOL_ELEMENTS, MEMPOOL_CACHE_SIZE, 0,	RTE_MBUF_DEFAULT_BUF_SIZE, rte_socket_id());
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		uint16_t portid = ports[p].portid;
+		if(!rte_eth_dev_is_valid_port(portid)) {
+			rte_exit(EXIT_FAILURE, "Invalid port %u\n", portid);
+		}
+
+		// everything used by the queues of the port is allocated on the socket of the NIC (SOCKET_ID_ANY for virtual devices)
+		ports[p].socket_id = rte_eth_dev_socket_id(portid);
 
-	if(pktmbuf_pool == NULL) {
-		rte_exit(EXIT_FAILURE, "Cannot init mbuf pool on socket %d\n", rte_socket_id());
+		// flush all flows of the NIC
+		struct rte_flow_error error;
+		rte_flow_flush(portid, &error);
+
+		if(init_DPDK_port(&ports[p], nb_rx_queue, nb_tx_queue) != 0) {
+			rte_exit(EXIT_FAILURE, "Cannot init port %u\n", portid);
+		}
 	}
 
-	// initialize the DPDK port
-	uint16_t nb_rx_queue = nr_queues;
-	uint16_t nb_tx_queue = nr_queues;
+	// the hardware RTT is kept if at least one port delivers the hardware timestamps (the others use only the software ones)
+	if(hw_timestamps) {
+		hw_timestamps = 0;
+		for(uint32_t p = 0; p < nr_ports; p++) {
+			hw_timestamps |= ports[p].hw_timestamps;
+		}
+	}
+}
+
+// Enable the RX timestamp offload and, if supported, the TX send on timestamp offload
+void init_hw_timestamps(port_t *port, struct rte_eth_conf *port_conf) {
+	uint16_t portid = port->portid;
+	struct rte_eth_dev_info dev_info;
+	if(rte_eth_dev_info_get(portid, &dev_info) != 0 || !(dev_info.rx_offload_capa & RTE_ETH_RX_OFFLOAD_TIMESTAMP)) {
+		RTE_LOG(WARNING, UDP_GENERATOR, "Port %u has no RX timestamp offload, using only the software timestamps\n", portid);
+		port->hw_timestamps = 0;
+		return;
+	}
 
-	if(init_DPDK_port(portid, nb_rx_queue, nb_tx_queue, pktmbuf_pool) != 0) {
-		rte_exit(EXIT_FAILURE, "Cannot init port %"PRIu8 "\n", 0);
+	// RX timestamp dynamic field filled by the NIC (the dynfields are the same for all ports)
+	if(rte_mbuf_dyn_rx_timestamp_register(&hw_rx_ts_offset, &hw_rx_ts_flag) != 0) {
+		RTE_LOG(WARNING, UDP_GENERATOR, "Cannot register the RX timestamp dynfield, using only the software timestamps\n");
+		port->hw_timestamps = 0;
+		return;
+	}
+	port_conf->rxmode.offloads |= RTE_ETH_RX_OFFLOAD_TIMESTAMP;
+
+	// TX timestamp dynamic field read by the NIC (the packet leaves exactly at the scheduled time)
+	if((dev_info.tx_offload_capa & RTE_ETH_TX_OFFLOAD_SEND_ON_TIMESTAMP) && rte_mbuf_dyn_tx_timestamp_register(&hw_tx_ts_offset, &hw_tx_ts_flag) == 0) {
+		port_conf->txmode.offloads |= RTE_ETH_TX_OFFLOAD_SEND_ON_TIMESTAMP;
+		port->hw_tx_ts = 1;
+	} else {
+		RTE_LOG(WARNING, UDP_GENERATOR, "Port %u has no TX send on timestamp offload, the hardware TX timestamp is the schedule in the NIC clock\n", portid);
 	}
 }
 
+// Measure the NIC clock frequency against the TSC with rte_eth_read_clock()
+void calibrate_hw_clock(port_t *port) {
+	uint16_t portid = port->portid;
+	uint64_t nic0, nic1;
+	if(rte_eth_read_clock(portid, &nic0) != 0) {
+		RTE_LOG(WARNING, UDP_GENERATOR, "Cannot read the clock of port %u, using only the software timestamps\n", portid);
+		port->hw_timestamps = 0;
+		return;
+	}
+	uint64_t tsc0 = rte_rdtsc_precise();
+
+	// wait for 100 ms
+	while((rte_rdtsc() - tsc0) < (100 * 1000 * TICKS_PER_US)) { }
+
+	rte_eth_read_clock(portid, &nic1);
+	uint64_t tsc1 = rte_rdtsc_precise();
+	if(nic1 <= nic0) {
+		RTE_LOG(WARNING, UDP_GENERATOR, "The clock of port %u does not advance, using only the software timestamps\n", portid);
+		port->hw_timestamps = 0;
+		return;
+	}
+
+	port->hw_clock[0].nic0 = nic1;
+	port->hw_clock[0].tsc0 = tsc1;
+	port->hw_clock[0].ticks_per_nic = ((double) (tsc1 - tsc0))/(nic1 - nic0);
+	port->hw_clock_cur = 0;
+	port->hw_ticks_per_nic0 = port->hw_clock[0].ticks_per_nic;
+	port->hw_clock_max_drift = 0;
+	port->hw_clock_nr_calibrations = 0;
+
+	printf("Port %u clock: %.3f MHz\n", portid, (TICKS_PER_US/port->hw_ticks_per_nic0));
+}
+
+// Map again the NIC clock to the TSC from the clock read since the last mapping (called every HW_CLOCK_CALIBRATE_MS
+// during the run), the drift is the NIC time predicted by the last mapping minus the one read
+void recalibrate_hw_clock(port_t *port) {
+	uint64_t nic;
+	if(rte_eth_read_clock(port->portid, &nic) != 0) {
+		return;
+	}
+	uint64_t tsc = rte_rdtsc_precise();
+
+	const hw_clock_t *cur = &port->hw_clock[port->hw_clock_cur];
+	if(nic <= cur->nic0) {
+		return;
+	}
+	double drift = (cur->nic0 + (tsc - cur->tsc0)/cur->ticks_per_nic - nic) * cur->ticks_per_nic;
+	drift = drift < 0 ? -drift : drift;
+	if(drift > port->hw_clock_max_drift) {
+		port->hw_clock_max_drift = drift;
+	}
+
+	// fill the other mapping and switch to it (the cores keep reading a complete one)
+	hw_clock_t *next = &port->hw_clock[1 - port->hw_clock_cur];
+	next->ticks_per_nic = ((double) (tsc - cur->tsc0))/(nic - cur->nic0);
+	next->nic0 = nic;
+	next->tsc0 = tsc;
+	rte_smp_wmb();
+	port->hw_clock_cur = 1 - port->hw_clock_cur;
+	port->hw_clock_nr_calibrations++;
+}
+
+// Print the drift of the NIC clock of each port against the TSC over the run
+void print_hw_clock_drift() {
+	double ticks_per_ns = (double)TICKS_PER_US/1000;
+	printf("\nNIC clock drift (recalibrated every %u ms):\n", HW_CLOCK_CALIBRATE_MS);
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		port_t *port = &ports[p];
+		if(!port->hw_timestamps) {
+			continue;
+		}
+		double ticks_per_nic = port->hw_clock[port->hw_clock_cur].ticks_per_nic;
+		printf("port %u: %u recalibrations, max drift %.0f ns, frequency change %.3f ppm\n", port->portid, port->hw_clock_nr_calibrations,
+			port->hw_clock_max_drift/ticks_per_ns, (port->hw_ticks_per_nic0/ticks_per_nic - 1) * 1000000);
+	}
+}
+
+// Configure the flow queue of the template/async rte_flow API, if the PMD supports it
+static void init_flow_engine(uint16_t portid) {
+	struct rte_flow_error err = {};
+	struct rte_flow_port_info port_info = {};
+	struct rte_flow_queue_info queue_info = {};
+	if(rte_flow_info_get(portid, &port_info, &queue_info, &err) != 0 || port_info.max_nb_queues == 0) {
+		return;
+	}
+
+	struct rte_flow_port_attr port_attr = {};
+	struct rte_flow_queue_attr queue_attr = { .size = FLOW_QUEUE_SIZE };
+	const struct rte_flow_queue_attr *queue_attrs[] = { &queue_attr };
+	if(queue_info.max_size && queue_attr.size > queue_info.max_size) {
+		queue_attr.size = queue_info.max_size;
+	}
+	if(queue_attr.size < FLOW_PUSH_BURST || rte_flow_configure(portid, &port_attr, 1, queue_attrs, &err) != 0) {
+		return;
+	}
+
+	flow_async[portid] = 1;
+	flow_queue_size[portid] = queue_attr.size;
+}
+
 // Initialize the DPDK port
-int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue, struct rte_mempool *mbuf_pool) {
+int init_DPDK_port(port_t *port, uint16_t nb_rx_queue, uint16_t nb_tx_queue) {
+	uint16_t portid = port->portid;
+
 	// configurable number of RX/TX ring descriptors
 	uint16_t nb_rxd = 4096;
 	uint16_t nb_txd = 4096;
@@ -60,6 +235,36 @@ int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue,
 		},
 	};
 
+	// keep only the offloads and the RSS hash types supported by the port (virtual devices have few of them)
+	struct rte_eth_dev_info dev_info = {};
+	if(rte_eth_dev_info_get(portid, &dev_info) == 0) {
+		port_conf.rxmode.offloads &= dev_info.rx_offload_capa;
+		port_conf.txmode.offloads &= dev_info.tx_offload_capa;
+		port_conf.rx_adv_conf.rss_conf.rss_hf &= dev_info.flow_type_rss_offloads;
+		if(port_conf.rx_adv_conf.rss_conf.rss_hf == 0) {
+			port_conf.rxmode.mq_mode = RTE_ETH_MQ_RX_NONE;
+		}
+	}
+
+	// the IPv4 checksum is computed in software if not offloaded (the UDP checksum stays 0)
+	port->tx_ol_flags = RTE_MBUF_F_TX_IPV4;
+	port->sw_ip_cksum = 0;
+	if(port_conf.txmode.offloads & RTE_ETH_TX_OFFLOAD_IPV4_CKSUM) {
+		port->tx_ol_flags |= RTE_MBUF_F_TX_IP_CKSUM;
+	} else {
+		port->sw_ip_cksum = 1;
+	}
+	if(port_conf.txmode.offloads & RTE_ETH_TX_OFFLOAD_UDP_CKSUM) {
+		port->tx_ol_flags |= RTE_MBUF_F_TX_UDP_CKSUM;
+	}
+
+	// enable the hardware timestamps supported by the NIC
+	port->hw_timestamps = hw_timestamps;
+	port->hw_tx_ts = 0;
+	if(port->hw_timestamps) {
+		init_hw_timestamps(port, &port_conf);
+	}
+
 	// configure the NIC
 	int retval = rte_eth_dev_configure(portid, nb_rx_queue, nb_tx_queue, &port_conf);
 	if(retval != 0) {
@@ -71,10 +276,16 @@ int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue,
 	if(retval != 0) {
 		return retval;
 	}
+	port->nb_rxd = nb_rxd;
+	port->nb_txd = nb_txd;
+
+	// the RX buffers hold any frame up to the default MTU (responses may be bigger than the requests)
+	uint32_t rx_data_room = RTE_PKTMBUF_HEADROOM + RTE_MAX(max_frame_size, (uint32_t) RTE_ETHER_MAX_LEN);
+	create_rx_mempools(port, RTE_MAX(rx_data_room, dev_info.min_rx_bufsize));
 
 	// setup the RX queues
 	for(int q = 0; q < nb_rx_queue; q++) {
-		retval = rte_eth_rx_queue_setup(portid, q, nb_rxd, rte_eth_dev_socket_id(portid), NULL, mbuf_pool);
+		retval = rte_eth_rx_queue_setup(portid, q, nb_rxd, port->socket_id, NULL, pktmbuf_pools[(port - ports) * nr_queues_per_port + q]);
 		if (retval < 0) {
 			return retval;
 		}
@@ -82,18 +293,26 @@ int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue,
 
 	// setup the TX queues
 	for(int q = 0; q < nb_tx_queue; q++) {
-		retval = rte_eth_tx_queue_setup(portid, q, nb_txd, rte_eth_dev_socket_id(portid), NULL);
+		retval = rte_eth_tx_queue_setup(portid, q, nb_txd, port->socket_id, NULL);
 		if (retval < 0) {
 			return retval;
 		}
 	}
 
+	// prepare the template/async rte_flow API (only before starting the port)
+	init_flow_engine(portid);
+
 	// start the Ethernet port
 	retval = rte_eth_dev_start(portid);
 	if(retval < 0) {
 		return retval;
 	}
 
+	// map the NIC clock to the TSC
+	if(port->hw_timestamps) {
+		calibrate_hw_clock(port);
+	}
+
 	// // enable the promiscuous mode
 	// retval = rte_eth_promiscuous_enable(portid);
 	// if(retval != 0)
@@ -170,26 +389,31 @@ void print_dpdk_stats(uint32_t portid) {
 	free(xstats_names);
 }
 
-// Create and fill rte_flow to send to the NIC
-void insert_flow(uint16_t portid, uint32_t i) {
-	int ret;
+// Fill the pattern and the actions of the rte_flow of a flow (the items are kept in spec until the rte_flow is created)
+static void build_flow(uint32_t i, flow_spec_t *spec, struct rte_flow_item *pattern, struct rte_flow_action *action) {
 	int act_idx = 0;
 	int pattern_idx = 0;
-	
-	struct rte_flow_attr attr = {};
-	struct rte_flow_error err = {};
-	struct rte_flow_item pattern[MAX_RTE_FLOW_PATTERN] = {};
-	struct rte_flow_action action[MAX_RTE_FLOW_ACTIONS] = {};
 
-	attr.egress = 0;
-    attr.ingress = 1;
+	// the responses come from the backend to the source address and port of the flow
+	flow_tuple_t *tuple = &flow_tuples[i];
+	memset(spec, 0, sizeof(flow_spec_t));
+	spec->queue_action.index = (i % nr_queues) % nr_queues_per_port;
+	spec->mark_action.id = i;
+	spec->ipv4.hdr.src_addr = backends[flow_backends[i]].dst_ipv4_addr;
+	spec->ipv4.hdr.dst_addr = tuple->src_addr;
+	spec->ipv4_mask.hdr.src_addr = 0xFFFFFFFF;
+	spec->ipv4_mask.hdr.dst_addr = 0xFFFFFFFF;
+	spec->udp.hdr.src_port = tuple->dst_port;
+	spec->udp.hdr.dst_port = tuple->src_port;
+	spec->udp_mask.hdr.src_port = 0xFFFF;
+	spec->udp_mask.hdr.dst_port = 0xFFFF;
 
 	action[act_idx].type= RTE_FLOW_ACTION_TYPE_QUEUE;
-	action[act_idx].conf = &control_blocks[i].flow_queue_action;
+	action[act_idx].conf = &spec->queue_action;
 	act_idx++;
 
 	action[act_idx].type = RTE_FLOW_ACTION_TYPE_MARK;
-	action[act_idx].conf = &control_blocks[i].flow_mark_action;
+	action[act_idx].conf = &spec->mark_action;
 	act_idx++;
 
 	action[act_idx].type = RTE_FLOW_ACTION_TYPE_END;
@@ -200,29 +424,189 @@ void insert_flow(uint16_t portid, uint32_t i) {
 	pattern_idx++;
 
 	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_IPV4;
-	pattern[pattern_idx].spec = &control_blocks[i].flow_ipv4;
-	pattern[pattern_idx].mask = &control_blocks[i].flow_ipv4_mask;
+	pattern[pattern_idx].spec = &spec->ipv4;
+	pattern[pattern_idx].mask = &spec->ipv4_mask;
 	pattern_idx++;
 
 	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_UDP;
-	pattern[pattern_idx].spec = &control_blocks[i].flow_udp;
-	pattern[pattern_idx].mask = &control_blocks[i].flow_udp_mask;
+	pattern[pattern_idx].spec = &spec->udp;
+	pattern[pattern_idx].mask = &spec->udp_mask;
 	pattern_idx++;
 
 	pattern[pattern_idx].type = RTE_FLOW_ITEM_TYPE_END;
 	pattern_idx++;
+}
+
+// Insert the rte_flow of every flow of the port one by one (returns the number of failures)
+static uint64_t insert_flows_sync(port_t *port, uint32_t first_flow, uint64_t nr_port_flows) {
+	uint16_t portid = port->portid;
+	uint64_t nr_failed = 0;
+	flow_spec_t spec;
+	struct rte_flow_attr attr = {};
+	struct rte_flow_error err = {};
+	struct rte_flow_item pattern[MAX_RTE_FLOW_PATTERN] = {};
+	struct rte_flow_action action[MAX_RTE_FLOW_ACTIONS] = {};
 
-	// validate the rte_flow
-	ret = rte_flow_validate(portid, &attr, pattern, action, &err);
-	if(ret < 0) {
+	attr.egress = 0;
+	attr.ingress = 1;
+
+	// validate only the first rte_flow (all of them have the same items and actions)
+	build_flow(first_flow, &spec, pattern, action);
+	if(rte_flow_validate(portid, &attr, pattern, action, &err) < 0) {
 		RTE_LOG(ERR, UDP_GENERATOR, "Flow validation failed %s\n", err.message);
+		return nr_port_flows;
+	}
+
+	for(uint32_t i = first_flow; i < nr_flows; i++) {
+		if(flow_port(i) != port) {
+			continue;
+		}
+
+		// create the flow and insert to the NIC
+		build_flow(i, &spec, pattern, action);
+		if(rte_flow_create(portid, &attr, pattern, action, &err) == NULL) {
+			if(nr_failed++ == 0) {
+				RTE_LOG(ERR, UDP_GENERATOR, "Flow creation return %s\n", err.message);
+			}
+		}
+	}
+
+	return nr_failed;
+}
+
+// Push the postponed rte_flows and collect the completed ones (returns the number of completions)
+static uint32_t complete_flows(uint16_t portid, uint64_t *nr_failed) {
+	struct rte_flow_error err = {};
+	struct rte_flow_op_result results[FLOW_PUSH_BURST];
+
+	rte_flow_push(portid, FLOW_QUEUE_ID, &err);
+	int n = rte_flow_pull(portid, FLOW_QUEUE_ID, results, FLOW_PUSH_BURST, &err);
+	if(n < 0) {
+		return 0;
+	}
+
+	for(int j = 0; j < n; j++) {
+		if(results[j].status != RTE_FLOW_OP_SUCCESS && (*nr_failed)++ == 0) {
+			RTE_LOG(ERR, UDP_GENERATOR, "Flow creation failed (asynchronous)\n");
+		}
+	}
+
+	return n;
+}
+
+// Insert the rte_flow of every flow of the port with the template/async API (returns the number of failures, -1 if not supported)
+static int64_t insert_flows_async(port_t *port, uint32_t first_flow, uint64_t nr_port_flows) {
+	uint16_t portid = port->portid;
+	flow_spec_t spec;
+	struct rte_flow_error err = {};
+	struct rte_flow_item pattern[MAX_RTE_FLOW_PATTERN] = {};
+	struct rte_flow_action action[MAX_RTE_FLOW_ACTIONS] = {};
+
+	// the templates keep only the masks, the values are given by each rte_flow
+	build_flow(first_flow, &spec, pattern, action);
+	for(int j = 0; pattern[j].type != RTE_FLOW_ITEM_TYPE_END; j++) {
+		pattern[j].spec = NULL;
+	}
+	for(int j = 0; action[j].type != RTE_FLOW_ACTION_TYPE_END; j++) {
+		action[j].conf = NULL;
+	}
+
+	struct rte_flow_pattern_template_attr pattern_attr = { .ingress = 1 };
+	struct rte_flow_pattern_template *pattern_template = rte_flow_pattern_template_create(portid, &pattern_attr, pattern, &err);
+	if(pattern_template == NULL) {
+		RTE_LOG(INFO, UDP_GENERATOR, "Cannot create the flow pattern template %s\n", err.message);
+		return -1;
+	}
+
+	struct rte_flow_actions_template_attr actions_attr = { .ingress = 1 };
+	struct rte_flow_actions_template *actions_template = rte_flow_actions_template_create(portid, &actions_attr, action, action, &err);
+	if(actions_template == NULL) {
+		RTE_LOG(INFO, UDP_GENERATOR, "Cannot create the flow actions template %s\n", err.message);
+		rte_flow_pattern_template_destroy(portid, pattern_template, &err);
+		return -1;
+	}
+
+	struct rte_flow_template_table_attr table_attr = { .flow_attr = { .ingress = 1 }, .nb_flows = nr_port_flows };
+	struct rte_flow_template_table *table = rte_flow_template_table_create(portid, &table_attr, &pattern_template, 1, &actions_template, 1, &err);
+	if(table == NULL) {
+		RTE_LOG(INFO, UDP_GENERATOR, "Cannot create the flow template table %s\n", err.message);
+		rte_flow_actions_template_destroy(portid, actions_template, &err);
+		rte_flow_pattern_template_destroy(portid, pattern_template, &err);
+		return -1;
+	}
+
+	uint64_t nr_failed = 0;
+	uint64_t nr_pending = 0;
+	uint32_t nr_postponed = 0;
+	struct rte_flow_op_attr op_attr = { .postpone = 1 };
+	for(uint32_t i = first_flow; i < nr_flows; i++) {
+		if(flow_port(i) != port) {
+			continue;
+		}
+
+		// keep room in the flow queue for a whole burst
+		while(nr_pending + FLOW_PUSH_BURST > flow_queue_size[portid]) {
+			nr_pending -= complete_flows(portid, &nr_failed);
+		}
+
+		build_flow(i, &spec, pattern, action);
+		if(rte_flow_async_create(portid, FLOW_QUEUE_ID, &op_attr, table, pattern, 0, action, 0, NULL, &err) == NULL) {
+			if(nr_failed++ == 0) {
+				RTE_LOG(ERR, UDP_GENERATOR, "Flow creation return %s\n", err.message);
+			}
+			continue;
+		}
+		nr_pending++;
+
+		// push the rte_flows to the NIC by bursts
+		if(++nr_postponed == FLOW_PUSH_BURST) {
+			nr_pending -= complete_flows(portid, &nr_failed);
+			nr_postponed = 0;
+		}
+	}
+
+	// wait for the remaining rte_flows
+	uint64_t deadline = rte_rdtsc() + FLOW_TIMEOUT_MS * 1000 * TICKS_PER_US;
+	while(nr_pending) {
+		nr_pending -= complete_flows(portid, &nr_failed);
+		if(rte_rdtsc() > deadline) {
+			rte_exit(EXIT_FAILURE, "Timed out waiting for %lu rte_flow completions.\n", nr_pending);
+		}
+	}
+
+	return nr_failed;
+}
+
+// Insert the rte_flow of every flow of the port (with the template/async API if the port supports it)
+void insert_flows(port_t *port) {
+	uint64_t t0 = rte_rdtsc_precise();
+
+	// flows owned by the queues of the port
+	uint32_t first_flow = nr_flows;
+	uint64_t nr_port_flows = 0;
+	for(uint32_t i = 0; i < nr_flows; i++) {
+		if(flow_port(i) == port) {
+			first_flow = RTE_MIN(first_flow, i);
+			nr_port_flows++;
+		}
+	}
+	if(nr_port_flows == 0) {
 		return;
 	}
 
-	// create the flow and insert to the NIC
-	struct rte_flow *rule = rte_flow_create(portid, &attr, pattern, action, &err);
-	if (rule == NULL) {
-		RTE_LOG(ERR, UDP_GENERATOR, "Flow creation return %s\n", err.message);
+	const char *api = "template/async";
+	int64_t nr_failed = flow_async[port->portid] ? insert_flows_async(port, first_flow, nr_port_flows) : -1;
+	if(nr_failed < 0) {
+		api = "sync";
+		nr_failed = insert_flows_sync(port, first_flow, nr_port_flows);
+	}
+
+	double seconds = ((double) (rte_rdtsc_precise() - t0))/(TICKS_PER_US * 1000000);
+	uint64_t nr_installed = nr_port_flows - nr_failed;
+	printf("rte_flow (port %u): %lu/%lu rules installed with the %s API in %.3f s (%.0f rules/s)\n",
+		port->portid, nr_installed, nr_port_flows, api, seconds, seconds > 0 ? nr_installed/seconds : 0.0);
+	if(nr_failed) {
+		RTE_LOG(WARNING, UDP_GENERATOR, "%lu rte_flow rules failed, their packets are steered by RSS\n", (uint64_t) nr_failed);
 	}
 }
 
@@ -231,20 +615,77 @@ void create_dpdk_rings() {
 	char s[64];
 	for(uint32_t i = 0; i < nr_queues; i++) {
 		snprintf(s, sizeof(s), "ring_rx%u", i);
-		rx_rings[i] = rte_ring_create(s, RING_ELEMENTS, rte_socket_id(), RING_F_SP_ENQ|RING_F_SC_DEQ);
+		// as big as the RX pool, so the RX ring never overflows (the NIC drops the packets first)
+		rx_rings[i] = rte_ring_create(s, rx_pool_elements(queue_port(i)), queue_socket(i), RING_F_SP_ENQ|RING_F_SC_DEQ|RING_F_EXACT_SZ);
 
 		if(rx_rings[i] == NULL) {
-			rte_exit(EXIT_FAILURE, "Cannot create the rings on socket %d\n", rte_socket_id());
+			rte_exit(EXIT_FAILURE, "Cannot create the rings on socket %d\n", queue_socket(i));
+		}
+	}
+}
+
+// create DPDK rings from the RX to the TX threads (closed-loop)
+void create_completion_rings() {
+	char s[64];
+	// enough room for every request in flight of the queue
+	uint32_t nr_elements = ((nr_flows + nr_queues - 1)/nr_queues) * outstanding;
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		// a ring from the RX core of every queue to each TX core of the same port (RSS may steer a response to any queue of the port)
+		for(uint32_t j = 0; j < nr_queues; j++) {
+			if(queue_port(i) != queue_port(j)) {
+				continue;
+			}
+
+			snprintf(s, sizeof(s), "ring_completion%u_%u", i, j);
+			completion_rings[i][j] = rte_ring_create(s, nr_elements, queue_socket(j), RING_F_SP_ENQ|RING_F_SC_DEQ|RING_F_EXACT_SZ);
+
+			if(completion_rings[i][j] == NULL) {
+				rte_exit(EXIT_FAILURE, "Cannot create the completion rings on socket %d\n", queue_socket(j));
+			}
 		}
 	}
 }
 
+// Create the TX packet pool of each queue with headers and payload filled once
+void create_tx_mempool() {
+	char s[64];
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		// TX mbufs are never touched by the RX, so their content survives the recycling
+		snprintf(s, sizeof(s), "mbuf_pool_tx%u", i);
+		pktmbuf_pools_tx[i] = rte_pktmbuf_pool_create(s, tx_pool_elements(queue_port(i)), MEMPOOL_CACHE_SIZE, 0, RTE_PKTMBUF_HEADROOM + max_frame_size, queue_socket(i));
+		if(pktmbuf_pools_tx[i] == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot init TX mbuf pool on socket %d\n", queue_socket(i));
+		}
+
+		// write the constant part of all packets
+		rte_mempool_obj_iter(pktmbuf_pools_tx[i], init_tx_pkt, queue_port(i));
+	}
+}
+
 // clear all DPDK structures allocated
 void clean_hugepages() {
 	for(uint32_t i = 0; i < nr_queues; i++) {
 		rte_ring_free(rx_rings[i]);
+		for(uint32_t j = 0; j < nr_queues; j++) {
+			rte_ring_free(completion_rings[i][j]);
+		}
+		rte_free(interarrival_gens[i]);
+		rte_free(flow_dists[i]->entries);
+		rte_free(flow_dists[i]);
+		rte_free(latency_hists[i]);
+		rte_free(warmup_hists[i]);
+		rte_free(hw_latency_hists[i]);
+		rte_free(send_late_hists[i]);
+		rte_free(send_early_hists[i]);
+		rte_free(never_sent_hists[i]);
+		rte_free(backend_hists[i]);
+		rte_free(backend_tx_pkts[i]);
+		rte_free(backend_rx_pkts[i]);
 	}
 	
-	rte_free(control_blocks);
-	rte_mempool_free(pktmbuf_pool);
+	clean_flow_table();
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		rte_mempool_free(pktmbuf_pools[i]);
+		rte_mempool_free(pktmbuf_pools_tx[i]);
+	}
 }
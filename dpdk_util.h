@@ -17,29 +17,73 @@
 #include <rte_ethdev.h>
 #include <rte_malloc.h>
 #include <rte_mempool.h>
+#include <rte_mbuf_dyn.h>
 
 #include "udp_util.h"
+#include "dist_util.h"
+#include "stats_util.h"
 
 #define SEED				        7
 #define BURST_SIZE    			    64
-#define RING_ELEMENTS			    512*1024
+#define RX_RING_BACKLOG			    32*1024
 #define MEMPOOL_CACHE_SIZE 		    512
 #define MAX_RTE_FLOW_PATTERN 		4
 #define MAX_RTE_FLOW_ACTIONS 		4
-#define PKTMBUF_POOL_ELEMENTS		512*1024 - 1
+#define FLOW_QUEUE_ID				0
+#define FLOW_QUEUE_SIZE				1024
+#define FLOW_PUSH_BURST				64
+#define FLOW_TIMEOUT_MS				10000
+#define HW_CLOCK_CALIBRATE_MS		1000
 #define RTE_LOGTYPE_UDP_GENERATOR 	RTE_LOGTYPE_USER1
 
+// Items and actions of the rte_flow of a flow (needed only while it is created)
+typedef struct flow_spec_s {
+	struct rte_flow_item_ipv4		ipv4;
+	struct rte_flow_item_ipv4		ipv4_mask;
+	struct rte_flow_item_udp		udp;
+	struct rte_flow_item_udp		udp_mask;
+	struct rte_flow_action_mark 	mark_action;
+	struct rte_flow_action_queue 	queue_action;
+} flow_spec_t;
+
 extern uint32_t min_lcores;
 extern uint64_t TICKS_PER_US;
 extern struct rte_ring *rx_rings[RTE_MAX_LCORE];
-extern struct rte_mempool *pktmbuf_pool;
-extern control_block_t *control_blocks;
+extern uint8_t soft_demux;
+extern struct rte_ring *completion_rings[RTE_MAX_LCORE][RTE_MAX_LCORE];
+extern uint32_t outstanding;
+extern uint8_t rx_rtc_mode;
+extern uint64_t nr_queues;
+extern uint64_t nr_flows;
+extern struct rte_mempool *pktmbuf_pools[RTE_MAX_LCORE];
+extern struct rte_mempool *pktmbuf_pools_tx[RTE_MAX_LCORE];
+extern histogram_t *latency_hists[RTE_MAX_LCORE];
+extern histogram_t *warmup_hists[RTE_MAX_LCORE];
+extern histogram_t *hw_latency_hists[RTE_MAX_LCORE];
+extern histogram_t *send_late_hists[RTE_MAX_LCORE];
+extern histogram_t *send_early_hists[RTE_MAX_LCORE];
+extern histogram_t *never_sent_hists[RTE_MAX_LCORE];
+extern histogram_t *backend_hists[RTE_MAX_LCORE];
+extern uint64_t *backend_tx_pkts[RTE_MAX_LCORE];
+extern uint64_t *backend_rx_pkts[RTE_MAX_LCORE];
+
+extern uint8_t hw_timestamps;
+extern int hw_rx_ts_offset;
+extern uint64_t hw_rx_ts_flag;
+extern int hw_tx_ts_offset;
+extern uint64_t hw_tx_ts_flag;
 
 void clean_hugepages();
 void print_DPDK_stats();
-void insert_flow(uint16_t portid, uint32_t i);
-void init_DPDK(uint16_t portid, uint64_t nr_queues);
+void insert_flows(port_t *port);
+void init_DPDK();
 void create_dpdk_rings();
-int init_DPDK_port(uint16_t portid, uint16_t nb_rx_queue, uint16_t nb_tx_queue, struct rte_mempool *mbuf_pool);
+void create_completion_rings();
+void create_tx_mempool();
+void calibrate_hw_clock(port_t *port);
+void recalibrate_hw_clock(port_t *port);
+void print_hw_clock_drift();
+void init_hw_timestamps(port_t *port, struct rte_eth_conf *port_conf);
+int init_DPDK_port(port_t *port, uint16_t nb_rx_queue, uint16_t nb_tx_queue);
 
 #endif // __DPDK_UTIL_H__
@@ -0,0 +1,817 @@
+#include "lcore_util.h"
+
+// Process the incoming UDP packet
+int process_rx_pkt(struct rte_mbuf *pkt, rx_context_t *ctx) {
+	// process only UDP packets
+	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	if(unlikely(ipv4_hdr->next_proto_id != IPPROTO_UDP)) {
+		return 0;
+	}
+
+	// get UDP header
+	struct rte_udp_hdr *udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + (ipv4_hdr->version_ihl & 0x0f)*4);
+
+	// get UDP payload size
+	uint32_t packet_data_size = rte_be_to_cpu_16(ipv4_hdr->total_length) - ((ipv4_hdr->version_ihl & 0x0f)*4) - sizeof(struct rte_udp_hdr);
+
+	// do not process empty packets
+	if(unlikely(packet_data_size == 0)) {
+		ctx->stats->nr_empty++;
+		return 0;
+	}
+
+	// obtain both timestamp from the packet
+	uint64_t *payload = (uint64_t *)(((uint8_t*) udp_hdr) + (sizeof(struct rte_udp_hdr)));
+	uint64_t t0 = payload[0];
+	uint64_t t1 = payload[1];
+
+	// obtain both hardware timestamps (in the NIC clock), if available
+	uint64_t hw_t0 = 0;
+	uint64_t hw_t1 = 0;
+	if(unlikely(ctx->port->hw_timestamps) && (pkt->ol_flags & hw_rx_ts_flag)) {
+		hw_t0 = payload[4];
+		hw_t1 = *RTE_MBUF_DYNFIELD(pkt, hw_rx_ts_offset, rte_mbuf_timestamp_t *);
+	}
+
+	// flow of the packet (from the rte_flow MARK if the NIC set it) and its sequence number in the flow
+	uint64_t flow_id = (pkt->ol_flags & RTE_MBUF_F_RX_FDIR_ID) ? pkt->hash.fdir.hi : (uint32_t) payload[2];
+	uint32_t seq = payload[2] >> 32;
+
+	// queue that sent the packet (the owner of the flow)
+	uint32_t owner = flow_id % nr_queues;
+
+	// the state of a flow is kept by the RX core of its queue (of any queue of the port in the software demux), a response
+	// steered to another queue (by RSS, without its rte_flow) or to another port is only counted
+	uint8_t owned = likely(flow_id < nr_flows) && (unlikely(soft_demux) ? queue_port(owner) == ctx->port : owner == ctx->qid);
+	if(unlikely(flow_id >= nr_flows)) {
+		ctx->stats->nr_unknown++;
+	} else if(unlikely(!owned)) {
+		ctx->stats->nr_misrouted++;
+	}
+
+	// detect the losses, duplicates and reordering of the flow (the RSS steers a flow always to the same RX core)
+	if(likely(owned)) {
+		seq_record(&seq_states[owner][flow_id / nr_queues], seq);
+	}
+
+	// notify the TX of the queue of the flow in closed-loop, only the queues of the same port have a ring (a completion lost
+	// in a full ring, or received by another port, times out)
+	if(ctx->completion_rings != NULL && likely(flow_id < nr_flows)) {
+		if(unlikely(queue_port(owner) != ctx->port)) {
+			ctx->stats->nr_completion_skips++;
+		} else if(unlikely(rte_ring_sp_enqueue(ctx->completion_rings[owner], (void*) (uintptr_t) (flow_id | ((uint64_t) seq << 32))) != 0)) {
+			ctx->stats->nr_completion_drops++;
+		}
+	}
+
+	// keep every sample only in the per-packet capture mode
+	if(unlikely(ctx->incoming != NULL)) {
+		// fill the node previously allocated
+		node_t *node = &ctx->incoming[(*ctx->incoming_idx)++];
+		node->flow_id = flow_id;
+		node->thread_id = payload[3];
+		node->timestamp_tx = t0;
+		node->timestamp_rx = t1;
+		node->hw_timestamp_tx = hw_t0;
+		node->hw_timestamp_rx = hw_t1;
+	}
+
+	// backend that answered the packet
+	uint32_t backend = 0;
+	if(unlikely(ctx->backend_hists != NULL) && flow_id < nr_flows) {
+		backend = flow_backends[flow_id];
+		ctx->backend_rx_pkts[backend]++;
+	}
+
+	// record the RTT in the phase the packet was sent (packets sent during its warm-up are apart)
+	if(likely(t1 > t0)) {
+		uint32_t phase = phase_of(ctx, t0);
+		uint8_t warmup = (t0 < phases[phase].warmup_tsc);
+		// the software demux keeps the histograms of every queue of the port in each RX core (the warm-up only per phase),
+		// a response of another port stays in the queue that received it
+		uint32_t slot = unlikely(soft_demux) ? ((likely(owned) ? owner : ctx->qid) % nr_queues_per_port) * nr_phases + phase : phase;
+		hist_record(likely(!warmup) ? &ctx->hists[slot] : &ctx->warmup_hists[phase], t1 - t0);
+
+		// the latency of each backend (all phases together)
+		if(unlikely(ctx->backend_hists != NULL) && flow_id < nr_flows && !warmup) {
+			hist_record(&ctx->backend_hists[backend], t1 - t0);
+		}
+
+		// record the hardware RTT (in ticks) and the error added by the generator
+		if(hw_t1 > hw_t0 && hw_t0 != 0 && !warmup) {
+			uint64_t hw_rtt = nic_to_ticks(ctx->port, hw_t1 - hw_t0);
+			hist_record(&ctx->hw_hists[slot], hw_rtt);
+			ctx->stats->hw_error_sum += (int64_t) ((t1 - t0) - hw_rtt);
+			ctx->stats->hw_nr_samples++;
+		}
+	}
+
+	ctx->stats->nr_pkts++;
+	ctx->stats->nr_bytes += pkt->pkt_len;
+
+	return 1;
+}
+
+// Start the client to configure the rte_flow properly
+void start_client() {
+	// insert the rte_flows in the NICs to retrieve the flow id for incoming packets of each flow
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		insert_flows(&ports[p]);
+	}
+}
+
+// RX processing (of the RX rings of the queues of the core)
+static int lcore_rx_ring(void *arg) {
+	lcore_role_t *conf = (lcore_role_t *) arg;
+	uint32_t n = conf->nr_queues;
+
+	uint64_t now;
+	uint16_t nb_rx;
+	rx_context_t ctx[n];
+	struct rte_ring *rx_ring[n];
+	struct rte_mbuf *pkts[BURST_SIZE];
+	for(uint32_t q = 0; q < n; q++) {
+		init_rx_context(&ctx[q], conf->qids[q]);
+		rx_ring[q] = rx_rings[conf->qids[q]];
+	}
+
+	while(!quit_rx_ring) {
+		for(uint32_t q = 0; q < n; q++) {
+			rx_stats_t *stats = ctx[q].stats;
+			// retrieve packets from the RX core
+			nb_rx = rte_ring_sc_dequeue_burst(rx_ring[q], (void**) pkts, BURST_SIZE, NULL); 
+			now = rte_rdtsc();
+			for(int i = 0; i < nb_rx; i++) {
+				rte_prefetch_non_temporal(rte_pktmbuf_mtod(pkts[i], void *));
+				// account the time spent from the RX core up to here
+				uint64_t ring_delay = now - read_payload_pkt(pkts[i], 1);
+				stats->ring_delay_sum += ring_delay;
+				if(ring_delay > stats->ring_delay_max) {
+					stats->ring_delay_max = ring_delay;
+				}
+				// process the incoming packet
+				process_rx_pkt(pkts[i], &ctx[q]);
+				// free the packet
+				rte_pktmbuf_free(pkts[i]);
+			}
+		}
+	}
+
+	// process all remaining packets that are in the RX rings (not from the NIC)
+	for(uint32_t q = 0; q < n; q++) {
+		do{
+			nb_rx = rte_ring_sc_dequeue_burst(rx_ring[q], (void**) pkts, BURST_SIZE, NULL);
+			for(int i = 0; i < nb_rx; i++) {
+				rte_prefetch_non_temporal(rte_pktmbuf_mtod(pkts[i], void *));
+				// process the incoming packet
+				process_rx_pkt(pkts[i], &ctx[q]);
+				// free the packet
+				rte_pktmbuf_free(pkts[i]);
+			}
+		} while (nb_rx != 0);
+	}
+
+	return 0;
+}
+
+// Main RX processing (polls the NIC queues of the core in turn)
+static int lcore_rx(void *arg) {
+	lcore_role_t *conf = (lcore_role_t *) arg;
+	uint32_t n = conf->nr_queues;
+
+	uint64_t now;
+	uint16_t nb_rx;
+	struct rte_mbuf *pkts[BURST_SIZE];
+	
+	while(!quit_rx) {
+		for(uint32_t q = 0; q < n; q++) {
+			lcore_param *rx_conf = &lcore_params[conf->qids[q]];
+
+			// retrieve the packets from the NIC
+			nb_rx = rte_eth_rx_burst(rx_conf->portid, rx_conf->port_qid, pkts, BURST_SIZE);
+
+			// retrive the current timestamp
+			now = rte_rdtsc();
+			for(int i = 0; i < nb_rx; i++) {
+				// fill the timestamp into packet payload
+				fill_payload_pkt(pkts[i], 1, now);
+			}
+			if(rte_ring_sp_enqueue_burst(rx_rings[rx_conf->qid], (void* const*) pkts, nb_rx, NULL) != nb_rx) {
+				rte_exit(EXIT_FAILURE, "Cannot enqueue the packet to the RX thread: %s.\n", rte_strerror(errno));
+			}
+		}
+	}
+
+	return 0;
+}
+
+// RX processing in run-to-completion (without the RX ring and the RX ring core)
+static int lcore_rx_rtc(void *arg) {
+	lcore_role_t *conf = (lcore_role_t *) arg;
+	uint32_t n = conf->nr_queues;
+
+	uint64_t now;
+	uint16_t nb_rx;
+	rx_context_t ctx[n];
+	struct rte_mbuf *pkts[BURST_SIZE];
+	for(uint32_t q = 0; q < n; q++) {
+		init_rx_context(&ctx[q], conf->qids[q]);
+	}
+
+	while(!quit_rx) {
+		for(uint32_t q = 0; q < n; q++) {
+			lcore_param *rx_conf = &lcore_params[conf->qids[q]];
+
+			// retrieve the packets from the NIC
+			nb_rx = rte_eth_rx_burst(rx_conf->portid, rx_conf->port_qid, pkts, BURST_SIZE);
+			if(nb_rx == 0) {
+				continue;
+			}
+
+			// retrive the current timestamp
+			now = rte_rdtsc();
+			for(int i = 0; i < nb_rx; i++) {
+				rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+			}
+
+			for(int i = 0; i < nb_rx; i++) {
+				// fill the timestamp into packet payload
+				fill_payload_pkt(pkts[i], 1, now);
+				// process the incoming packet
+				process_rx_pkt(pkts[i], &ctx[q]);
+			}
+
+			// free the packets
+			rte_pktmbuf_free_bulk(pkts, nb_rx);
+		}
+	}
+
+	return 0;
+}
+
+// Schedule of the next packet of the queue: after the next interarrival gap, or at the time of the next packet of the trace
+// (REPLAY_PENDING until the reader reads it, UINT64_MAX after the trace)
+static inline uint64_t next_schedule(uint64_t tsc, uint64_t start_tsc, interarrival_gen_t *gen, replay_queue_t *replay) {
+	if(likely(replay == NULL)) {
+		return tsc + next_interarrival(gen);
+	}
+
+	const replay_desc_t *desc = replay_peek(replay);
+	if(likely(desc != NULL)) {
+		return start_tsc + desc->offset;
+	}
+
+	return replay_ended(replay) ? UINT64_MAX : REPLAY_PENDING;
+}
+
+// TX state of a queue (a TX core sends the queues of its role in turn)
+typedef struct tx_queue_s {
+	uint32_t qid;
+	uint16_t portid;
+	uint16_t port_qid;
+	port_t *port;
+	tx_stats_t *stats;
+	struct rte_mempool *tx_pool;
+	flow_dist_t *flow_dist;
+	interarrival_gen_t *interarrival_gen;
+	replay_queue_t *replay;
+	uint64_t *backend_tx;
+	uint32_t *tx_seq;
+
+	// phase of the schedule being sent
+	uint32_t phase;
+	size_model_t *sizes;
+	flow_dist_t *size_dist;
+	const size_class_t *size_class;
+	uint64_t start_tsc;
+	uint64_t warmup_tsc;
+	uint64_t end_tsc;
+	histogram_t *late_hist;
+	histogram_t *early_hist;
+	histogram_t *never_sent_hist;
+	uint64_t next_tsc;
+
+	// burst ready to be sent when its first packet is due (no packet at the end of the schedule)
+	uint16_t nb_pkts;
+	uint64_t burst_tsc;
+	uint64_t pkts_tsc[BURST_SIZE];
+	struct rte_mbuf *pkts[BURST_SIZE];
+
+	// closed-loop (the completion rings of the RX cores of the port are read in turn)
+	uint32_t first_source;
+	uint32_t last_source;
+	uint32_t source;
+	uint64_t next_scan;
+} __rte_cache_aligned tx_queue_t;
+
+// Allocate the TX state of the queues of a TX core
+static tx_queue_t *create_tx_queues(lcore_role_t *conf) {
+	tx_queue_t *queues = (tx_queue_t *) rte_zmalloc_socket("tx_queues", conf->nr_queues * sizeof(tx_queue_t), RTE_CACHE_LINE_SIZE, rte_socket_id());
+	if(queues == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the TX queues.\n");
+	}
+
+	for(uint32_t q = 0; q < conf->nr_queues; q++) {
+		tx_queue_t *tq = &queues[q];
+		uint32_t qid = conf->qids[q];
+		tq->qid = qid;
+		tq->portid = lcore_params[qid].portid;
+		tq->port_qid = lcore_params[qid].port_qid;
+		tq->port = queue_port(qid);
+		tq->stats = &tx_stats[qid];
+		tq->tx_pool = pktmbuf_pools_tx[qid];
+		tq->flow_dist = flow_dists[qid];
+		tq->interarrival_gen = interarrival_gens[qid];
+		tq->replay = replay_queues[qid];
+		tq->backend_tx = backend_tx_pkts[qid];
+		tq->tx_seq = tx_seqs[qid];
+		tq->first_source = qid - tq->port_qid;
+		tq->last_source = tq->first_source + nr_queues_per_port - 1;
+		tq->source = tq->first_source;
+	}
+
+	return queues;
+}
+
+// Start sending a phase of the schedule on the queue
+static void tx_start_phase(tx_queue_t *tq, uint32_t p) {
+	phase_t *phase = &phases[p];
+
+	// switch to the rate and the distribution of the phase (the first one is ready)
+	if(p > 0 && tq->replay == NULL) {
+		reset_interarrival_gen(tq->interarrival_gen, phase->distribution, phase->rate);
+	}
+
+	tq->phase = p;
+	tq->sizes = &phase->sizes;
+	tq->size_dist = phase->size_dists[tq->qid];
+	tq->size_class = &tq->sizes->classes[0];
+	tq->start_tsc = phase->start_tsc;
+	tq->warmup_tsc = phase->warmup_tsc;
+	tq->end_tsc = phase->end_tsc;
+	// send time minus scheduled time of the packets sent and lateness of the packets never sent (after the warm-up)
+	tq->late_hist = &send_late_hists[tq->qid][p];
+	tq->early_hist = &send_early_hists[tq->qid][p];
+	tq->never_sent_hist = &never_sent_hists[tq->qid][p];
+	tq->next_tsc = next_schedule(tq->start_tsc, tq->start_tsc, tq->interarrival_gen, tq->replay);
+}
+
+// Fill the scheduled timestamp into the packet payload (also in the NIC clock, sent at that time if the NIC supports it)
+static inline void tx_stamp_pkt(tx_queue_t *tq, struct rte_mbuf *pkt, uint64_t tsc) {
+	fill_payload_pkt(pkt, 0, tsc);
+	if(unlikely(tq->port->hw_timestamps)) {
+		uint64_t hw_tsc = tsc_to_nic(tq->port, tsc);
+		fill_payload_pkt(pkt, 4, hw_tsc);
+		if(tq->port->hw_tx_ts) {
+			*RTE_MBUF_DYNFIELD(pkt, hw_tx_ts_offset, rte_mbuf_timestamp_t *) = hw_tsc;
+			pkt->ol_flags |= hw_tx_ts_flag;
+		}
+	}
+}
+
+// Generate the next burst of the phase (synthetic or replayed from a trace), no packet at the end of the phase
+static uint16_t tx_build_burst(tx_queue_t *tq, uint64_t window) {
+	uint16_t nb_pkts = 0;
+	struct rte_mbuf **pkts = tq->pkts;
+	replay_queue_t *replay = tq->replay;
+	interarrival_gen_t *interarrival_gen = tq->interarrival_gen;
+	uint64_t end_tsc = tq->end_tsc;
+	uint64_t start_tsc = tq->start_tsc;
+	uint64_t next_tsc = tq->next_tsc;
+	uint64_t now;
+
+	tq->nb_pkts = 0;
+
+	// the next packet of the trace is not read yet (the other queues of the core go on meanwhile)
+	if(unlikely(next_tsc == REPLAY_PENDING)) {
+		next_tsc = tq->next_tsc = next_schedule(next_tsc, start_tsc, interarrival_gen, replay);
+		if(next_tsc == REPLAY_PENDING) {
+			return 0;
+		}
+	}
+
+	// reach the end of the phase
+	if(unlikely(next_tsc >= end_tsc)) {
+		return 0;
+	}
+
+	// the burst is sent when its first packet is due
+	uint64_t burst_tsc = next_tsc;
+
+	// generate all packets due within the burst window (and every packet already due in catch-up), the late policy is
+	// applied right before the burst is sent
+	do {
+		now = rte_rdtsc();
+
+		uint32_t flow_id;
+		pkts[nb_pkts] = rte_pktmbuf_alloc(tq->tx_pool);
+		if(unlikely(replay != NULL)) {
+			// the packet of the trace with its 5-tuple and size
+			const replay_desc_t *desc = replay_peek(replay);
+			flow_id = desc->flow_id;
+			fill_replay_packet(desc, pkts[nb_pkts]);
+			replay_pop(replay);
+		} else {
+			// choose the flow to send
+			flow_id = next_flow(tq->flow_dist);
+			// choose the frame size (the lengths of every size class are precomputed)
+			if(tq->size_dist != NULL) {
+				tq->size_class = &tq->sizes->classes[next_flow(tq->size_dist)];
+			}
+			// fill the packet with the flow information
+			fill_udp_packet(flow_id, tq->size_class, pkts[nb_pkts]);
+		}
+		// fill the payload to gather server information (the flow, numbered in the flow once the packet is sure to be sent)
+		fill_payload_pkt(pkts[nb_pkts], 2, flow_id);
+		tx_stamp_pkt(tq, pkts[nb_pkts], next_tsc);
+
+		tq->pkts_tsc[nb_pkts++] = next_tsc;
+		next_tsc = next_schedule(next_tsc, start_tsc, interarrival_gen, replay);
+	} while((nb_pkts == 0 || (nb_pkts < BURST_SIZE && (next_tsc < burst_tsc + window || (late_policy == LATE_CATCHUP && next_tsc <= now)))) && next_tsc < end_tsc);
+
+	tq->next_tsc = next_tsc;
+	tq->burst_tsc = burst_tsc;
+	tq->nb_pkts = nb_pkts;
+
+	return nb_pkts;
+}
+
+// Generate the next burst of the queue, in the next phases once a phase is over (no packet at the end of the schedule)
+static uint16_t tx_next_burst(tx_queue_t *tq, uint64_t window) {
+	while(tx_build_burst(tq, window) == 0) {
+		if(tq->phase + 1 == nr_phases || tq->next_tsc == REPLAY_PENDING || quit_tx) {
+			return 0;
+		}
+		tx_start_phase(tq, tq->phase + 1);
+	}
+
+	return tq->nb_pkts;
+}
+
+// Send all packets of the burst (0 if they all fit in the TX ring at once)
+static inline uint16_t send_all(uint16_t portid, uint16_t qid, struct rte_mbuf **pkts, uint16_t nb_pkts) {
+	uint16_t nb_tx = rte_eth_tx_burst(portid, qid, pkts, nb_pkts);
+	uint16_t nb_retries = 0;
+	while(unlikely(nb_tx < nb_pkts)) {
+		nb_tx += rte_eth_tx_burst(portid, qid, pkts + nb_tx, nb_pkts - nb_tx);
+		nb_retries++;
+	}
+
+	return nb_retries;
+}
+
+// Apply the late policy to the burst of the queue right before it is sent (the TX core may have sent the bursts of its
+// other queues since it was built), and number the packets kept in their flows
+static void tx_check_burst(tx_queue_t *tq, uint64_t now, uint64_t late_threshold) {
+	tx_stats_t *stats = tq->stats;
+	uint16_t nb_pkts = 0;
+	for(uint16_t j = 0; j < tq->nb_pkts; j++) {
+		struct rte_mbuf *pkt = tq->pkts[j];
+
+		// unable to keep up with the requested rate
+		if(unlikely(now > tq->pkts_tsc[j] + late_threshold)) {
+			if(late_policy == LATE_DROP) {
+				// count this packet as dropped (and how late it was)
+				stats->nr_never_sent++;
+				if(tq->pkts_tsc[j] >= tq->warmup_tsc) {
+					hist_record(tq->never_sent_hist, now - tq->pkts_tsc[j]);
+				}
+				rte_pktmbuf_free(pkt);
+				continue;
+			} else if(late_policy == LATE_SHIFT) {
+				// delay the rest of the schedule by the lateness (this packet and the next ones of the burst get the shifted timestamp)
+				uint64_t shift = now - tq->pkts_tsc[j];
+				stats->nr_shifts++;
+				stats->shift_sum += shift;
+				for(uint16_t k = j; k < tq->nb_pkts; k++) {
+					tq->pkts_tsc[k] += shift;
+					tx_stamp_pkt(tq, tq->pkts[k], tq->pkts_tsc[k]);
+				}
+				tq->start_tsc += shift;
+				if(tq->next_tsc < REPLAY_PENDING) {
+					tq->next_tsc += shift;
+				}
+			} else {
+				// sent in a catch-up burst with its scheduled timestamp, so the RTT includes the lateness
+				stats->nr_caught_up++;
+			}
+		}
+
+		// the sequence number of the packet in its flow
+		uint32_t flow_id = (uint32_t) read_payload_pkt(pkt, 2);
+		fill_payload_pkt(pkt, 2, flow_id | ((uint64_t) tq->tx_seq[flow_id / nr_queues]++ << 32));
+		if(unlikely(tq->backend_tx != NULL)) {
+			tq->backend_tx[flow_backends[flow_id]]++;
+		}
+		stats->nr_bytes += pkt->pkt_len;
+
+		tq->pkts_tsc[nb_pkts] = tq->pkts_tsc[j];
+		tq->pkts[nb_pkts++] = pkt;
+	}
+	tq->nb_pkts = nb_pkts;
+}
+
+// Send the burst of the queue
+static void tx_send_burst(tx_queue_t *tq, uint64_t send_tsc) {
+	tx_stats_t *stats = tq->stats;
+	uint16_t nb_pkts = tq->nb_pkts;
+
+	// send the batch (waiting for room if the TX ring is full, the burst is then sent when the wait is over)
+	if(unlikely(send_all(tq->portid, tq->port_qid, tq->pkts, nb_pkts))) {
+		send_tsc = rte_rdtsc();
+	}
+
+	// account the pacing error of each packet (sent ahead or behind its schedule)
+	for(int j = 0; j < nb_pkts; j++) {
+		uint8_t late = (send_tsc >= tq->pkts_tsc[j]);
+		uint64_t error = late ? send_tsc - tq->pkts_tsc[j] : tq->pkts_tsc[j] - send_tsc;
+		stats->pacing_error_sum += error;
+		if(error > stats->pacing_error_max) {
+			stats->pacing_error_max = error;
+		}
+		if(likely(tq->pkts_tsc[j] >= tq->warmup_tsc)) {
+			hist_record(late ? tq->late_hist : tq->early_hist, error);
+		}
+	}
+
+	// update the counters
+	stats->nr_pkts += nb_pkts;
+	stats->nr_bursts++;
+	tq->nb_pkts = 0;
+}
+
+// Main TX processing (the next burst sent is the earliest one of the queues of the core)
+static int lcore_tx(void *arg) {
+	lcore_role_t *conf = (lcore_role_t *) arg;
+	uint32_t n = conf->nr_queues;
+	uint64_t window = (burst_window_ns * TICKS_PER_US)/1000;
+	uint64_t late_threshold = late_threshold_us * TICKS_PER_US;
+	uint64_t send_tsc;
+
+	tx_queue_t *queues = create_tx_queues(conf);
+	for(uint32_t q = 0; q < n; q++) {
+		tx_start_phase(&queues[q], 0);
+		tx_next_burst(&queues[q], window);
+	}
+
+	while(!quit_tx) {
+		// the queues waiting for the trace reader get their burst once it read their next packet
+		uint8_t waiting = 0;
+		for(uint32_t q = 0; q < n; q++) {
+			if(unlikely(queues[q].next_tsc == REPLAY_PENDING) && queues[q].nb_pkts == 0) {
+				waiting |= (tx_next_burst(&queues[q], window) == 0);
+			}
+		}
+
+		// the queue with the earliest burst (none at the end of the schedule of every queue)
+		tx_queue_t *tq = NULL;
+		for(uint32_t q = 0; q < n; q++) {
+			if(queues[q].nb_pkts && (tq == NULL || queues[q].burst_tsc < tq->burst_tsc)) {
+				tq = &queues[q];
+			}
+		}
+		if(unlikely(tq == NULL)) {
+			if(waiting) {
+				continue;
+			}
+			break;
+		}
+
+		// sleep for while (refilling the interarrival ring if there is slack, or checking the queues waiting for the reader)
+		while ((send_tsc = rte_rdtsc()) < tq->burst_tsc) {
+			if(likely(tq->replay == NULL)) {
+				refill_interarrival_idle(tq->interarrival_gen, send_tsc, tq->burst_tsc);
+			} else if(waiting) {
+				break;
+			}
+		}
+		if(send_tsc < tq->burst_tsc) {
+			continue;
+		}
+
+		// the lateness is the one of the packets when the burst is sent (all of them may be dropped)
+		tx_check_burst(tq, send_tsc, late_threshold);
+		if(likely(tq->nb_pkts)) {
+			tx_send_burst(tq, send_tsc);
+		}
+		tx_next_burst(tq, window);
+	}
+
+	// free the bursts not sent (interrupted)
+	for(uint32_t q = 0; q < n; q++) {
+		rte_pktmbuf_free_bulk(queues[q].pkts, queues[q].nb_pkts);
+	}
+	rte_free(queues);
+
+	return 0;
+}
+
+// Trace reader (streams the trace into the rings of the TX queues)
+int lcore_replay(void *arg) {
+	replay_trace();
+
+	return 0;
+}
+
+// Binary output writer
+static int lcore_writer(void *arg) {
+	lcore_param *conf = (lcore_param *) arg;
+
+	write_binary_output(conf->qid);
+
+	return 0;
+}
+
+// Write the binary output of all queues in parallel (one writer per worker lcore)
+void launch_writers() {
+	uint32_t id_lcore = rte_lcore_id();
+	for(int i = 0; i < nr_queues; i++) {
+		id_lcore = rte_get_next_lcore(id_lcore, 1, 1);
+		// reuse the lcore only after its previous writer finished
+		rte_eal_wait_lcore(id_lcore);
+		rte_eal_remote_launch(lcore_writer, (void*) &lcore_params[i], id_lcore);
+	}
+
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH_WORKER(lcore_id) {
+		rte_eal_wait_lcore(lcore_id);
+	}
+}
+
+// Send a new request of the flow in the slot (the burst is sent once full)
+static inline void tx_closed_loop_request(tx_queue_t *tq, uint32_t flow_id, request_t *req, uint64_t now) {
+	struct rte_mbuf *pkt = rte_pktmbuf_alloc(tq->tx_pool);
+	if(tq->size_dist != NULL) {
+		tq->size_class = &tq->sizes->classes[next_flow(tq->size_dist)];
+	}
+	fill_udp_packet(flow_id, tq->size_class, pkt);
+	tq->stats->nr_bytes += tq->size_class->frame_size;
+
+	// the slot keeps the sequence number of the request to match its response
+	req->seq = tq->tx_seq[flow_id / nr_queues]++;
+	req->tsc = now;
+	fill_payload_pkt(pkt, 2, flow_id | ((uint64_t) req->seq << 32));
+	tx_stamp_pkt(tq, pkt, now);
+	if(unlikely(tq->backend_tx != NULL)) {
+		tq->backend_tx[flow_backends[flow_id]]++;
+	}
+
+	tq->pkts[tq->nb_pkts++] = pkt;
+	if(tq->nb_pkts == BURST_SIZE) {
+		send_all(tq->portid, tq->port_qid, tq->pkts, tq->nb_pkts);
+		tq->stats->nr_pkts += tq->nb_pkts;
+		tq->stats->nr_bursts++;
+		tq->nb_pkts = 0;
+	}
+}
+
+// Release the requests of the queue in closed-loop (a new request for each response, and for every request that timed out)
+static void tx_closed_loop_step(tx_queue_t *tq, uint64_t now, uint64_t timeout) {
+	uint16_t nb_done;
+	void *done[BURST_SIZE];
+	tx_stats_t *stats = tq->stats;
+
+	// fill the free slots of all flows of the queue (at the beginning and after the requests that timed out)
+	if(unlikely(now >= tq->next_scan)) {
+		for(uint64_t f = tq->qid; f < nr_flows; f += nr_queues) {
+			request_t *slots = flow_request_slots(f);
+			for(uint32_t k = 0; k < outstanding; k++) {
+				if(slots[k].tsc && (now - slots[k].tsc) > timeout) {
+					stats->nr_timeouts++;
+					slots[k].tsc = 0;
+				}
+				if(slots[k].tsc == 0) {
+					tx_closed_loop_request(tq, f, &slots[k], rte_rdtsc());
+				}
+			}
+		}
+		tq->next_scan = rte_rdtsc() + timeout;
+	}
+
+	// a new request for each response received by the RX (of every queue of the port in turn)
+	struct rte_ring *completion_ring = completion_rings[tq->source][tq->qid];
+	tq->source = (tq->source == tq->last_source) ? tq->first_source : tq->source + 1;
+	nb_done = rte_ring_sc_dequeue_burst(completion_ring, done, BURST_SIZE, NULL);
+	now = rte_rdtsc();
+	for(int j = 0; j < nb_done; j++) {
+		uint64_t completion = (uint64_t) (uintptr_t) done[j];
+		uint32_t flow_id = (uint32_t) completion;
+		uint32_t seq = completion >> 32;
+
+		// the response frees the slot of its request, unless the request already timed out (and was sent again)
+		request_t *slots = flow_request_slots(flow_id);
+		uint32_t k = 0;
+		while(k < outstanding && !(slots[k].tsc && slots[k].seq == seq)) {
+			k++;
+		}
+		if(unlikely(k == outstanding)) {
+			stats->nr_stale++;
+			continue;
+		}
+		tx_closed_loop_request(tq, flow_id, &slots[k], now);
+	}
+
+	if(tq->nb_pkts) {
+		send_all(tq->portid, tq->port_qid, tq->pkts, tq->nb_pkts);
+		stats->nr_pkts += tq->nb_pkts;
+		stats->nr_bursts++;
+		tq->nb_pkts = 0;
+	}
+}
+
+// Main TX processing in closed-loop (each response releases a new request of the same flow)
+static int lcore_tx_closed_loop(void *arg) {
+	lcore_role_t *conf = (lcore_role_t *) arg;
+	uint32_t n = conf->nr_queues;
+	uint64_t timeout = CLOSED_LOOP_TIMEOUT_US * TICKS_PER_US;
+	uint64_t end_tsc = phases[0].end_tsc;
+	uint64_t now;
+
+	// a single phase in closed-loop
+	tx_queue_t *queues = create_tx_queues(conf);
+	for(uint32_t q = 0; q < n; q++) {
+		queues[q].sizes = &phases[0].sizes;
+		queues[q].size_dist = phases[0].size_dists[queues[q].qid];
+		queues[q].size_class = &phases[0].sizes.classes[0];
+	}
+
+	// start with the open-loop TX cores, so the warm-up is the same
+	while(rte_rdtsc() < phases[0].start_tsc && !quit_tx) { }
+
+	while(!quit_tx) {
+		now = rte_rdtsc();
+		if(unlikely(now >= end_tsc)) {
+			break;
+		}
+
+		for(uint32_t q = 0; q < n; q++) {
+			tx_closed_loop_step(&queues[q], now, timeout);
+		}
+	}
+
+	rte_free(queues);
+
+	return 0;
+}
+
+// Give a free worker core the role for a queue, preferably on the socket of its NIC
+uint32_t pick_lcore(uint32_t qid, uint8_t role) {
+	int socket_id = queue_socket(qid);
+
+	uint32_t lcore_id;
+	uint32_t chosen = RTE_MAX_LCORE;
+	RTE_LCORE_FOREACH_WORKER(lcore_id) {
+		if(lcore_roles[lcore_id].role != ROLE_NONE) {
+			continue;
+		}
+		if(socket_id == SOCKET_ID_ANY || (int) rte_lcore_to_socket_id(lcore_id) == socket_id) {
+			chosen = lcore_id;
+			break;
+		}
+		// the first free core of another socket if there is none left on the socket of the NIC
+		if(chosen == RTE_MAX_LCORE) {
+			chosen = lcore_id;
+		}
+	}
+
+	if(chosen == RTE_MAX_LCORE) {
+		rte_exit(EXIT_FAILURE, "No available worker cores!\n");
+	}
+	lcore_roles[chosen].role = role;
+	lcore_roles[chosen].qids[lcore_roles[chosen].nr_queues++] = qid;
+
+	return chosen;
+}
+
+// Give each queue its own RX ring, RX and TX cores (without an lcore map)
+void assign_default_lcores() {
+	for(int i = 0; i < nr_queues; i++) {
+		if(!rx_rtc_mode) {
+			pick_lcore(i, ROLE_RX_RING);
+		}
+		pick_lcore(i, ROLE_RX);
+		pick_lcore(i, ROLE_TX);
+	}
+}
+
+// Start the RX and TX cores (each core serves the queues of its role)
+void launch_workers() {
+	// the NIC queue of each queue
+	for(int i = 0; i < nr_queues; i++) {
+		lcore_params[i].portid = queue_port(i)->portid;
+		lcore_params[i].port_qid = i % nr_queues_per_port;
+		lcore_params[i].qid = i;
+	}
+
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH_WORKER(lcore_id) {
+		lcore_role_t *conf = &lcore_roles[lcore_id];
+		if(conf->role == ROLE_RX_RING) {
+			rte_eal_remote_launch(lcore_rx_ring, (void*) conf, lcore_id);
+		} else if(conf->role == ROLE_RX) {
+			rte_eal_remote_launch(rx_rtc_mode ? lcore_rx_rtc : lcore_rx, (void*) conf, lcore_id);
+		} else if(conf->role == ROLE_TX) {
+			rte_eal_remote_launch(outstanding ? lcore_tx_closed_loop : lcore_tx, (void*) conf, lcore_id);
+		}
+	}
+}
@@ -0,0 +1,28 @@
+#ifndef __LCORE_UTIL_H__
+#define __LCORE_UTIL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <rte_eal.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_launch.h>
+#include <rte_malloc.h>
+
+#include "util.h"
+#include "udp_util.h"
+#include "dpdk_util.h"
+#include "replay_util.h"
+
+int process_rx_pkt(struct rte_mbuf *pkt, rx_context_t *ctx);
+void start_client();
+int lcore_replay(void *arg);
+void launch_writers();
+uint32_t pick_lcore(uint32_t qid, uint8_t role);
+void assign_default_lcores();
+void launch_workers();
+
+#endif // __LCORE_UTIL_H__
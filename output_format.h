@@ -0,0 +1,57 @@
+#ifndef __OUTPUT_FORMAT_H__
+#define __OUTPUT_FORMAT_H__
+
+#include <stdint.h>
+
+// Binary output: one file per queue and phase (<output>.<queue> or <output>.p<phase>.<queue>) with a header followed by nr_records records
+#define OUTPUT_MAGIC					0x47504455		// "UDPG"
+#define OUTPUT_VERSION					2
+#define OUTPUT_TYPE_CAPTURE				0				// output_capture_t records
+#define OUTPUT_TYPE_HISTOGRAM			1				// output_bucket_t records
+#define OUTPUT_TYPE_CAPTURE_HW			2				// output_capture_hw_t records
+#define OUTPUT_TYPE_HISTOGRAM_HW		3				// output_bucket_hw_t records
+
+typedef struct output_header_s {
+	uint32_t						magic;
+	uint16_t						version;
+	uint16_t						type;
+	uint64_t						ticks_per_us;
+	uint32_t						queue;
+	uint32_t						nr_queues;
+	uint64_t						nr_flows;
+	uint32_t						phase;			// phase of the schedule
+	uint32_t						nr_phases;
+	uint64_t						rate;			// in pps
+	uint32_t						frame_size;		// average, in bytes
+	uint64_t						warmup_samples;	// samples dropped for warming up (capture only)
+	uint64_t						warmup_ticks;	// duration of the warming up
+	uint64_t						nr_records;
+} __attribute__((packed)) output_header_t;
+
+// RTT of one packet
+typedef struct output_capture_s {
+	uint32_t						flow_id;
+	uint64_t						rtt;			// in ticks
+} __attribute__((packed)) output_capture_t;
+
+// Software and hardware RTT of one packet
+typedef struct output_capture_hw_s {
+	uint32_t						flow_id;
+	uint64_t						rtt;			// in ticks
+	uint64_t						hw_rtt;			// in ticks, 0 if not available
+} __attribute__((packed)) output_capture_hw_t;
+
+// Non-empty histogram bucket
+typedef struct output_bucket_s {
+	uint64_t						value;			// lowest RTT of the bucket, in ticks
+	uint64_t						count;
+} __attribute__((packed)) output_bucket_t;
+
+// Non-empty bucket of the software or the hardware histogram
+typedef struct output_bucket_hw_s {
+	uint64_t						value;			// lowest RTT of the bucket, in ticks
+	uint64_t						count;
+	uint64_t						hw_count;
+} __attribute__((packed)) output_bucket_hw_t;
+
+#endif // __OUTPUT_FORMAT_H__
@@ -0,0 +1,374 @@
+#include "replay_util.h"
+
+char replay_file[MAXSTRLEN];
+replay_queue_t *replay_queues[RTE_MAX_LCORE];
+volatile uint8_t replay_done;
+
+// Speed-up factor of the trace (2 replays it twice faster)
+static double replay_speedup = 1;
+
+// Descriptors parsed for each queue and not enqueued yet
+static replay_desc_t pending[RTE_MAX_LCORE][REPLAY_BURST];
+static uint32_t nr_pending[RTE_MAX_LCORE];
+static uint64_t last_offset[RTE_MAX_LCORE];
+
+// Progress of the reader
+static int trace_fd = -1;
+static size_t released;
+static uint8_t started;
+static uint64_t first_ns;
+static uint64_t last_ns;
+static uint64_t offset_limit;
+static uint64_t nr_replayed;
+static uint64_t nr_skipped;
+static uint64_t nr_clamped;
+
+// Parse FILENAME[:SPEEDUP] (-1 if invalid)
+int parse_replay(const char *spec) {
+	snprintf(replay_file, sizeof(replay_file), "%s", spec);
+
+	// the speed-up factor is optional (the file name itself may have a ':')
+	char *sep = strrchr(replay_file, ':');
+	if(sep) {
+		char *end = NULL;
+		double speedup = strtod(sep + 1, &end);
+		if(end != sep + 1 && *end == '\0') {
+			if(speedup <= 0) {
+				return -1;
+			}
+			replay_speedup = speedup;
+			*sep = '\0';
+		}
+	}
+
+	return replay_file[0] ? 0 : -1;
+}
+
+// Create the descriptor ring of each TX queue (on the socket of its NIC)
+void create_replay_queues() {
+	char s[64];
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		replay_queue_t *rq = (replay_queue_t*) rte_zmalloc_socket("replay_queue", sizeof(replay_queue_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+		if(rq == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot alloc the replay queue.\n");
+		}
+
+		snprintf(s, sizeof(s), "ring_replay%u", i);
+		rq->ring = rte_ring_create_elem(s, sizeof(replay_desc_t), REPLAY_RING_SIZE, queue_socket(i), RING_F_SP_ENQ|RING_F_SC_DEQ);
+		if(rq->ring == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot create the replay rings on socket %d\n", queue_socket(i));
+		}
+
+		replay_queues[i] = rq;
+	}
+
+	// nothing after the end of the run is read
+	offset_limit = (phases[0].warmup + phases[0].duration) * 1000000 * TICKS_PER_US;
+}
+
+// Enqueue the parsed descriptors of a queue that fit in its ring (the others stay pending)
+static void push_pending(uint32_t qid) {
+	if(nr_pending[qid] == 0) {
+		return;
+	}
+
+	uint32_t n = rte_ring_sp_enqueue_burst_elem(replay_queues[qid]->ring, pending[qid], sizeof(replay_desc_t), nr_pending[qid], NULL);
+	memmove(pending[qid], &pending[qid][n], (nr_pending[qid] - n) * sizeof(replay_desc_t));
+	nr_pending[qid] -= n;
+}
+
+// Enqueue the parsed descriptors of a queue, waiting while its ring is full (the descriptors of the other queues are
+// handed over meanwhile, a TX core may wait for them before it drains this ring)
+static void flush_pending(uint32_t qid) {
+	push_pending(qid);
+	while(nr_pending[qid] && !quit_tx) {
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			push_pending(i);
+		}
+	}
+	nr_pending[qid] = 0;
+}
+
+// Parse a packet of the trace and hand it to the queue of its 5-tuple (-1 at the end of the run)
+static int replay_packet(const uint8_t *data, uint32_t caplen, uint32_t orig_len, uint64_t ts_ns) {
+	// Ethernet, with an optional VLAN tag (the packet is sent untagged)
+	uint32_t off = sizeof(struct rte_ether_hdr);
+	if(caplen < off) {
+		nr_skipped++;
+		return 0;
+	}
+	uint16_t ether_type = rte_be_to_cpu_16(((const struct rte_ether_hdr*) data)->ether_type);
+	if(ether_type == RTE_ETHER_TYPE_VLAN && caplen >= off + sizeof(struct rte_vlan_hdr)) {
+		ether_type = rte_be_to_cpu_16(((const struct rte_vlan_hdr*) (data + off))->eth_proto);
+		off += sizeof(struct rte_vlan_hdr);
+	}
+
+	// only UDP over IPv4 (the first fragment has the UDP header)
+	const struct rte_ipv4_hdr *ipv4_hdr = (const struct rte_ipv4_hdr*) (data + off);
+	if(ether_type != RTE_ETHER_TYPE_IPV4 || caplen < off + sizeof(struct rte_ipv4_hdr) || ipv4_hdr->next_proto_id != IPPROTO_UDP ||
+		(rte_be_to_cpu_16(ipv4_hdr->fragment_offset) & RTE_IPV4_HDR_OFFSET_MASK) != 0) {
+		nr_skipped++;
+		return 0;
+	}
+	uint32_t ihl = (ipv4_hdr->version_ihl & RTE_IPV4_HDR_IHL_MASK) * RTE_IPV4_IHL_MULTIPLIER;
+	if(caplen < off + ihl + sizeof(struct rte_udp_hdr)) {
+		nr_skipped++;
+		return 0;
+	}
+	const struct rte_udp_hdr *udp_hdr = (const struct rte_udp_hdr*) (data + off + ihl);
+
+	// time since the first packet replayed (in ticks, time-scaled)
+	if(!started) {
+		first_ns = ts_ns;
+		started = 1;
+	}
+	last_ns = RTE_MAX(last_ns, ts_ns);
+	uint64_t offset = ts_ns > first_ns ? (uint64_t) (((ts_ns - first_ns) * ((double) TICKS_PER_US/1000))/replay_speedup) : 0;
+	if(offset >= offset_limit) {
+		return -1;
+	}
+
+	// the packets of a 5-tuple are sent by the same queue, always with the same flow id of that queue
+	uint64_t key = (((uint64_t) ipv4_hdr->src_addr << 32) | ipv4_hdr->dst_addr) ^ (((uint64_t) udp_hdr->src_port << 16) | udp_hdr->dst_port);
+	uint32_t hash = (uint32_t) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+	uint32_t qid = hash % nr_queues;
+	uint32_t nr_queue_flows = (nr_flows - qid + nr_queues - 1)/nr_queues;
+
+	// the frame keeps its original size, if it fits the payload values and the mbufs
+	uint32_t size = orig_len - (off - sizeof(struct rte_ether_hdr));
+	if(size < min_frame_size() || size > REPLAY_MAX_FRAME_SIZE) {
+		size = RTE_MIN(RTE_MAX(size, min_frame_size()), (uint32_t) REPLAY_MAX_FRAME_SIZE);
+		nr_clamped++;
+	}
+
+	replay_desc_t *desc = &pending[qid][nr_pending[qid]++];
+	desc->offset = RTE_MAX(offset, last_offset[qid]);
+	desc->flow_id = qid + nr_queues * ((hash / nr_queues) % nr_queue_flows);
+	desc->src_addr = ipv4_hdr->src_addr;
+	desc->dst_addr = ipv4_hdr->dst_addr;
+	desc->src_port = udp_hdr->src_port;
+	desc->dst_port = udp_hdr->dst_port;
+	init_size_class(&desc->size_class, size);
+	last_offset[qid] = desc->offset;
+	nr_replayed++;
+
+	if(nr_pending[qid] == REPLAY_BURST) {
+		flush_pending(qid);
+	}
+
+	return quit_tx ? -1 : 0;
+}
+
+// Read a 16/32-bit value of the trace (in the byte order of the file)
+static inline uint16_t read16(const uint8_t *p, uint8_t swapped) {
+	uint16_t v;
+	memcpy(&v, p, sizeof(v));
+
+	return swapped ? rte_bswap16(v) : v;
+}
+static inline uint32_t read32(const uint8_t *p, uint8_t swapped) {
+	uint32_t v;
+	memcpy(&v, p, sizeof(v));
+
+	return swapped ? rte_bswap32(v) : v;
+}
+
+// Drop the part of the trace already read from the memory (the trace may not fit in RAM)
+static void release_trace(const uint8_t *base, size_t pos) {
+	size_t page = sysconf(_SC_PAGESIZE);
+	size_t end = (pos/page) * page;
+	if(end - released >= REPLAY_RELEASE_SIZE) {
+		madvise((void*) (base + released), end - released, MADV_DONTNEED);
+		posix_fadvise(trace_fd, released, end - released, POSIX_FADV_DONTNEED);
+		released = end;
+	}
+}
+
+// Replay a pcap file (microsecond or nanosecond timestamps, any byte order)
+static void replay_pcap(const uint8_t *base, size_t size) {
+	uint32_t magic = read32(base, 0);
+	uint8_t swapped = (magic == rte_bswap32(PCAP_MAGIC_US) || magic == rte_bswap32(PCAP_MAGIC_NS));
+	uint8_t nanoseconds = (magic == PCAP_MAGIC_NS || magic == rte_bswap32(PCAP_MAGIC_NS));
+	if(size < 24 || read32(base + 20, swapped) != PCAP_LINKTYPE_ETHERNET) {
+		rte_exit(EXIT_FAILURE, "The trace %s is not an Ethernet capture.\n", replay_file);
+	}
+
+	size_t pos = 24;
+	while(pos + 16 <= size) {
+		uint64_t ts_sec = read32(base + pos, swapped);
+		uint64_t ts_frac = read32(base + pos + 4, swapped);
+		uint32_t caplen = read32(base + pos + 8, swapped);
+		uint32_t orig_len = read32(base + pos + 12, swapped);
+		pos += 16;
+		if(pos + caplen > size) {
+			break;
+		}
+
+		uint64_t ts_ns = ts_sec * 1000000000 + (nanoseconds ? ts_frac : ts_frac * 1000);
+		if(replay_packet(base + pos, caplen, orig_len, ts_ns) < 0) {
+			break;
+		}
+		pos += caplen;
+		release_trace(base, pos);
+	}
+}
+
+// Replay a pcapng file (enhanced packet blocks of the Ethernet interfaces)
+static void replay_pcapng(const uint8_t *base, size_t size) {
+	uint32_t nr_interfaces = 0;
+	uint16_t linktypes[PCAP_MAX_INTERFACES];
+	uint64_t units_per_sec[PCAP_MAX_INTERFACES];
+
+	size_t pos = 0;
+	while(pos + 12 <= size) {
+		uint32_t type = read32(base + pos, 0);
+		uint32_t length = read32(base + pos + 4, 0);
+		if(length < 12 || pos + length > size) {
+			break;
+		}
+
+		if(type == PCAPNG_BLOCK_SHB) {
+			// a new section has its own interfaces
+			if(read32(base + pos + 8, 0) != PCAPNG_BYTE_ORDER_MAGIC) {
+				rte_exit(EXIT_FAILURE, "The trace %s has a pcapng section of another byte order.\n", replay_file);
+			}
+			nr_interfaces = 0;
+		} else if(type == PCAPNG_BLOCK_IDB && nr_interfaces < PCAP_MAX_INTERFACES) {
+			linktypes[nr_interfaces] = read16(base + pos + 8, 0);
+			units_per_sec[nr_interfaces] = 1000000;
+
+			// timestamp resolution option (a power of 10, or of 2 with the high bit)
+			size_t opt = pos + 16;
+			while(opt + 4 <= pos + length - 4) {
+				uint16_t code = read16(base + opt, 0);
+				uint16_t opt_length = read16(base + opt + 2, 0);
+				if(code == 0) {
+					break;
+				}
+				if(code == PCAPNG_OPT_IF_TSRESOL && opt_length >= 1) {
+					uint8_t resol = base[opt + 4];
+					uint64_t units = 1;
+					for(uint32_t i = 0; i < (resol & 0x7f); i++) {
+						units *= (resol & 0x80) ? 2 : 10;
+					}
+					units_per_sec[nr_interfaces] = units;
+				}
+				opt += 4 + ((opt_length + 3) & ~3);
+			}
+			nr_interfaces++;
+		} else if(type == PCAPNG_BLOCK_EPB && length >= 32) {
+			uint32_t ifid = read32(base + pos + 8, 0);
+			uint64_t ts = ((uint64_t) read32(base + pos + 12, 0) << 32) | read32(base + pos + 16, 0);
+			uint32_t caplen = read32(base + pos + 20, 0);
+			uint32_t orig_len = read32(base + pos + 24, 0);
+			if(ifid < nr_interfaces && linktypes[ifid] == PCAP_LINKTYPE_ETHERNET && 28 + caplen <= length) {
+				uint64_t units = units_per_sec[ifid];
+				uint64_t ts_ns = (ts/units) * 1000000000 + ((ts % units) * 1000000000)/units;
+				if(replay_packet(base + pos + 28, caplen, orig_len, ts_ns) < 0) {
+					break;
+				}
+			}
+		}
+
+		pos += length;
+		release_trace(base, pos);
+	}
+}
+
+// Stream the trace into the rings of the TX queues (runs on its own lcore until the end of the trace or of the run)
+void replay_trace() {
+	trace_fd = open(replay_file, O_RDONLY);
+	if(trace_fd < 0) {
+		rte_exit(EXIT_FAILURE, "Cannot open the trace %s.\n", replay_file);
+	}
+
+	struct stat st;
+	if(fstat(trace_fd, &st) != 0 || st.st_size < 4) {
+		rte_exit(EXIT_FAILURE, "The trace %s is empty.\n", replay_file);
+	}
+
+	// the whole file is mapped, but only the pages being read stay in memory
+	const uint8_t *base = (const uint8_t*) mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, trace_fd, 0);
+	if(base == MAP_FAILED) {
+		rte_exit(EXIT_FAILURE, "Cannot map the trace %s.\n", replay_file);
+	}
+	madvise((void*) base, st.st_size, MADV_SEQUENTIAL);
+
+	uint32_t magic = read32(base, 0);
+	if(magic == PCAPNG_BLOCK_SHB) {
+		replay_pcapng(base, st.st_size);
+	} else if(magic == PCAP_MAGIC_US || magic == PCAP_MAGIC_NS || magic == rte_bswap32(PCAP_MAGIC_US) || magic == rte_bswap32(PCAP_MAGIC_NS)) {
+		replay_pcap(base, st.st_size);
+	} else {
+		rte_exit(EXIT_FAILURE, "The trace %s is not a pcap or pcapng file.\n", replay_file);
+	}
+
+	// hand the last packets to the queues before telling them the trace is over
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		flush_pending(i);
+	}
+	rte_smp_wmb();
+	replay_done = 1;
+
+	munmap((void*) base, st.st_size);
+	close(trace_fd);
+}
+
+// Wait until the reader filled a ring (it waits for room) or read the whole trace
+void wait_replay_prefill() {
+	while(!replay_done) {
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			if(rte_ring_free_count(replay_queues[i]->ring) == 0) {
+				return;
+			}
+		}
+	}
+}
+
+// Fill the packet with the addresses, the ports and the size of the trace (Ethernet header of the port of the queue)
+void fill_replay_packet(const replay_desc_t *desc, struct rte_mbuf *pkt) {
+	const backend_t *backend = &backends[flow_backends[desc->flow_id]];
+	const port_t *port = &ports[backend->port];
+
+	// ensure that IP/UDP checksum offloadings (those supported by the port)
+	pkt->ol_flags |= port->tx_ol_flags;
+
+	// copy the headers of the backend of the flow and overwrite them with the trace
+	rte_memcpy(rte_pktmbuf_mtod(pkt, uint8_t*), backend->hdr_template, PKT_HDR_SIZE);
+
+	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	ipv4_hdr->src_addr = desc->src_addr;
+	ipv4_hdr->dst_addr = desc->dst_addr;
+	ipv4_hdr->total_length = desc->size_class.ip_total_length;
+
+	struct rte_udp_hdr *udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+	udp_hdr->src_port = desc->src_port;
+	udp_hdr->dst_port = desc->dst_port;
+	udp_hdr->dgram_len = desc->size_class.udp_dgram_len;
+
+	// compute the IPv4 checksum if the port cannot
+	if(unlikely(port->sw_ip_cksum)) {
+		ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+	}
+	pkt->data_len = desc->size_class.frame_size;
+	pkt->pkt_len = pkt->data_len;
+}
+
+// Print what was replayed from the trace
+void print_replay_stats() {
+	printf("\nReplay Stats:\n");
+	printf("%s: %lu packets replayed (%.3f s of trace at x%.2f), %lu skipped (not UDP/IPv4), %lu resized to fit between %u and %u bytes\n",
+		replay_file, nr_replayed, (last_ns - first_ns)/1e9, replay_speedup,
+		nr_skipped, nr_clamped, min_frame_size(), REPLAY_MAX_FRAME_SIZE
+	);
+}
+
+// Free the replay queues
+void clean_replay() {
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		if(replay_queues[i]) {
+			rte_ring_free(replay_queues[i]->ring);
+			rte_free(replay_queues[i]);
+		}
+	}
+}
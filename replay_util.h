@@ -0,0 +1,95 @@
+#ifndef __REPLAY_UTIL_H__
+#define __REPLAY_UTIL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_ether.h>
+#include <rte_malloc.h>
+#include <rte_byteorder.h>
+
+#include "util.h"
+
+#define REPLAY_BURST				64
+#define REPLAY_RING_SIZE			64*1024
+#define REPLAY_RELEASE_SIZE			64*1024*1024
+#define REPLAY_MAX_FRAME_SIZE		1514
+#define REPLAY_PENDING				(UINT64_MAX - 1)
+#define PCAP_MAX_INTERFACES			16
+#define PCAP_MAGIC_US				0xa1b2c3d4
+#define PCAP_MAGIC_NS				0xa1b23c4d
+#define PCAP_LINKTYPE_ETHERNET		1
+#define PCAPNG_BLOCK_SHB			0x0a0d0d0a
+#define PCAPNG_BLOCK_IDB			1
+#define PCAPNG_BLOCK_EPB			6
+#define PCAPNG_BYTE_ORDER_MAGIC		0x1a2b3c4d
+#define PCAPNG_OPT_IF_TSRESOL		9
+
+// Packet of the trace ready to be sent (parsed by the reader, 32 bytes)
+typedef struct replay_desc_s {
+	uint64_t						offset;			// since the first packet of the trace (in ticks, time-scaled)
+	uint32_t						flow_id;
+	uint32_t						src_addr;
+	uint32_t						dst_addr;
+	uint16_t						src_port;
+	uint16_t						dst_port;
+	size_class_t					size_class;
+} replay_desc_t;
+
+// Packets of the trace sent by a TX queue (read from its ring by bursts)
+typedef struct replay_queue_s {
+	struct rte_ring					*ring;
+	uint32_t						head;
+	uint32_t						count;
+	replay_desc_t					descs[REPLAY_BURST];
+} __rte_cache_aligned replay_queue_t;
+
+extern char replay_file[MAXSTRLEN];
+extern replay_queue_t *replay_queues[RTE_MAX_LCORE];
+extern volatile uint8_t replay_done;
+
+int parse_replay(const char *spec);
+void create_replay_queues();
+void replay_trace();
+void wait_replay_prefill();
+void print_replay_stats();
+void clean_replay();
+void fill_replay_packet(const replay_desc_t *desc, struct rte_mbuf *pkt);
+
+// Next packet of the trace for the queue, without taking it (NULL if the reader has not read it yet, or at the end of the trace)
+static inline const replay_desc_t *replay_peek(replay_queue_t *rq) {
+	if(unlikely(rq->head == rq->count)) {
+		rq->count = rte_ring_sc_dequeue_burst_elem(rq->ring, rq->descs, sizeof(replay_desc_t), REPLAY_BURST, NULL);
+		rq->head = 0;
+		if(rq->count == 0) {
+			return NULL;
+		}
+	}
+
+	return &rq->descs[rq->head];
+}
+
+// Whether every packet of the trace for the queue was taken
+static inline uint8_t replay_ended(replay_queue_t *rq) {
+	// the reader enqueues all packets before setting the done flag
+	uint8_t done = replay_done;
+	rte_smp_rmb();
+
+	return done && replay_peek(rq) == NULL;
+}
+
+// Take the packet returned by replay_peek()
+static inline void replay_pop(replay_queue_t *rq) {
+	rq->head++;
+}
+
+#endif // __REPLAY_UTIL_H__
@@ -0,0 +1,88 @@
+#include "stats_util.h"
+
+// Allocate an empty histogram
+histogram_t *hist_create(const char *name) {
+	return hist_create_array(name, 1, SOCKET_ID_ANY);
+}
+
+// Allocate n contiguous empty histograms on the socket
+histogram_t *hist_create_array(const char *name, uint32_t n, int socket_id) {
+	histogram_t *hist = (histogram_t*) rte_malloc_socket(name, n * sizeof(histogram_t), RTE_CACHE_LINE_SIZE, socket_id);
+	if(hist == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the %s histogram.\n", name);
+	}
+	for(uint32_t i = 0; i < n; i++) {
+		hist_reset(&hist[i]);
+	}
+
+	return hist;
+}
+
+// Clear all values of the histogram
+void hist_reset(histogram_t *hist) {
+	memset(hist, 0, sizeof(histogram_t));
+	hist->min = UINT64_MAX;
+}
+
+// Add all values of src into dst
+void hist_merge(histogram_t *dst, const histogram_t *src) {
+	for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+		dst->buckets[i] += src->buckets[i];
+	}
+	dst->count += src->count;
+	dst->sum += src->sum;
+	dst->min = RTE_MIN(dst->min, src->min);
+	dst->max = RTE_MAX(dst->max, src->max);
+}
+
+// Value below which the given percentile (0-100) of the recorded values fall
+uint64_t hist_percentile(const histogram_t *hist, double percentile) {
+	if(hist->count == 0) {
+		return 0;
+	}
+
+	uint64_t target = (uint64_t) ((percentile/100.0) * hist->count);
+	if(target >= hist->count) {
+		return hist->max;
+	}
+
+	uint64_t seen = 0;
+	for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+		seen += hist->buckets[i];
+		if(seen > target) {
+			return RTE_MIN(RTE_MAX(hist_value(i), hist->min), hist->max);
+		}
+	}
+
+	return hist->max;
+}
+
+// Number of values recorded in [low, high) (with the bucket precision)
+uint64_t hist_count_range(const histogram_t *hist, uint64_t low, uint64_t high) {
+	uint64_t count = 0;
+	for(uint32_t i = hist_index(low); i < HIST_NR_BUCKETS && hist_value(i) < high; i++) {
+		count += hist->buckets[i];
+	}
+
+	return count;
+}
+
+// Add the values recorded in cur since the last call into dst, and update the last snapshot
+// (cur may be updated concurrently by its single writer, only the buckets are read)
+void hist_delta(histogram_t *dst, histogram_t *last, const histogram_t *cur) {
+	for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+		uint64_t value = *((volatile const uint64_t*) &cur->buckets[i]);
+		uint64_t delta = value - last->buckets[i];
+		if(delta == 0) {
+			continue;
+		}
+		last->buckets[i] = value;
+
+		// min and max are known only with the bucket precision
+		dst->buckets[i] += delta;
+		dst->count += delta;
+		dst->sum += delta * hist_value(i);
+		dst->min = RTE_MIN(dst->min, hist_value(i));
+		dst->max = RTE_MAX(dst->max, hist_value(i));
+	}
+}
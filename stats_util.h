@@ -0,0 +1,68 @@
+#ifndef __STATS_UTIL_H__
+#define __STATS_UTIL_H__
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <rte_eal.h>
+#include <rte_common.h>
+#include <rte_malloc.h>
+
+// Log-linear histogram: values below 2^HIST_SUB_BUCKET_BITS are exact, then every
+// power of two is split into HIST_HALF_BUCKETS buckets (relative error < 1/64)
+#define HIST_SUB_BUCKET_BITS			7
+#define HIST_HALF_BUCKETS				(1 << (HIST_SUB_BUCKET_BITS - 1))
+#define HIST_NR_BUCKETS					((64 - HIST_SUB_BUCKET_BITS + 2) * HIST_HALF_BUCKETS)
+
+typedef struct histogram_s {
+	uint64_t						count;
+	uint64_t						sum;
+	uint64_t						min;
+	uint64_t						max;
+	uint64_t						buckets[HIST_NR_BUCKETS];
+} __rte_cache_aligned histogram_t;
+
+histogram_t *hist_create(const char *name);
+histogram_t *hist_create_array(const char *name, uint32_t n, int socket_id);
+void hist_reset(histogram_t *hist);
+void hist_merge(histogram_t *dst, const histogram_t *src);
+uint64_t hist_percentile(const histogram_t *hist, double percentile);
+uint64_t hist_count_range(const histogram_t *hist, uint64_t low, uint64_t high);
+void hist_delta(histogram_t *dst, histogram_t *last, const histogram_t *cur);
+
+// Index of the bucket of a value
+static inline uint32_t hist_index(uint64_t value) {
+	if(value < 2*HIST_HALF_BUCKETS) {
+		return value;
+	}
+
+	uint32_t shift = (63 - __builtin_clzll(value)) - (HIST_SUB_BUCKET_BITS - 1);
+	return shift*HIST_HALF_BUCKETS + (value >> shift);
+}
+
+// Lowest value of a bucket
+static inline uint64_t hist_value(uint32_t idx) {
+	if(idx < 2*HIST_HALF_BUCKETS) {
+		return idx;
+	}
+
+	uint32_t shift = idx/HIST_HALF_BUCKETS - 1;
+	return ((uint64_t) (idx - shift*HIST_HALF_BUCKETS)) << shift;
+}
+
+// Record a value into the histogram
+static inline void hist_record(histogram_t *hist, uint64_t value) {
+	hist->buckets[hist_index(value)]++;
+	hist->count++;
+	hist->sum += value;
+	if(value < hist->min) {
+		hist->min = value;
+	}
+	if(value > hist->max) {
+		hist->max = value;
+	}
+}
+
+#endif // __STATS_UTIL_H__
@@ -0,0 +1,383 @@
+// Benchmark of the generator itself, without NIC nor server: microbenchmarks of the per-packet
+// functions and a run of the TX and RX cores against a virtual device (net_ring loops the packets back)
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "util.h"
+#include "udp_util.h"
+#include "dpdk_util.h"
+#include "replay_util.h"
+#include "lcore_util.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION				"unknown"
+#endif
+
+#define BENCH_ITERATIONS			10000000
+#define BENCH_FLOWS					4096
+#define BENCH_RUN_S					1
+#define BENCH_DRAIN_MS				100
+#define BENCH_FLOOR_RATE			10000
+#define BENCH_START_RATE			1000000
+#define BENCH_MAX_RATE				1000000000
+#define BENCH_SEARCH_STEPS			6
+
+// Counters of a run of the TX and RX cores
+typedef struct bench_run_s {
+	uint64_t rate;
+	uint64_t nr_sent;
+	uint64_t nr_late;
+	uint64_t nr_received;
+} bench_run_t;
+
+// Keep the results of the microbenchmarks alive
+static volatile uint64_t bench_sink;
+
+// Nanoseconds per iteration of a loop that took the ticks
+static double bench_ns(double ticks, uint64_t iterations) {
+	return (ticks * 1000.0)/(TICKS_PER_US * (double) iterations);
+}
+
+// Flows of the queue 0 sampled from its popularity model (the microbenchmarks cycle through them)
+static uint32_t bench_flows[BENCH_FLOWS];
+
+// Fill path before the header templates (the baseline of fill_udp_packet): every header field and payload byte of each packet
+static void fill_udp_packet_fields(uint32_t i, const size_class_t *sc, struct rte_mbuf *pkt) {
+	const flow_tuple_t *tuple = &flow_tuples[i];
+	const backend_t *backend = &backends[flow_backends[i]];
+	const port_t *port = &ports[backend->port];
+
+	// ensure that IP/UDP checksum offloadings (those supported by the port)
+	pkt->ol_flags |= port->tx_ol_flags;
+
+	// fill Ethernet information
+	struct rte_ether_hdr *eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
+	eth_hdr->dst_addr = backend->dst_eth_addr;
+	eth_hdr->src_addr = port->src_eth_addr;
+	eth_hdr->ether_type = ETH_IPV4_TYPE_NETWORK;
+
+	// fill IPv4 information
+	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	ipv4_hdr->version_ihl = 0x45;
+	ipv4_hdr->total_length = rte_cpu_to_be_16(sc->frame_size - sizeof(struct rte_ether_hdr));
+	ipv4_hdr->time_to_live = 255;
+	ipv4_hdr->packet_id = 0;
+	ipv4_hdr->next_proto_id = IPPROTO_UDP;
+	ipv4_hdr->fragment_offset = 0;
+	ipv4_hdr->src_addr = tuple->src_addr;
+	ipv4_hdr->dst_addr = backend->dst_ipv4_addr;
+	ipv4_hdr->hdr_checksum = 0;
+
+	// fill UDP information
+	struct rte_udp_hdr *udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+	udp_hdr->dst_port = tuple->dst_port;
+	udp_hdr->src_port = tuple->src_port;
+	udp_hdr->dgram_len = rte_cpu_to_be_16(sc->frame_size - sizeof(struct rte_ether_hdr) - sizeof(struct rte_ipv4_hdr));
+	udp_hdr->dgram_cksum = 0;
+
+	// fill the payload of the packet one byte at a time
+	uint8_t *payload = ((uint8_t*) udp_hdr) + sizeof(struct rte_udp_hdr);
+	for(uint32_t j = 0; j < sc->frame_size - PKT_HDR_SIZE; j++) {
+		payload[j] = 'A';
+	}
+
+	// compute the IPv4 checksum if the port cannot
+	if(unlikely(port->sw_ip_cksum)) {
+		ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+	}
+	pkt->data_len = sc->frame_size;
+	pkt->pkt_len = pkt->data_len;
+}
+
+// Build a packet of the flow table with a fill path (in ticks per packet)
+static double bench_fill(void (*fill)(uint32_t, const size_class_t *, struct rte_mbuf *)) {
+	const size_class_t *size_class = &phases[0].sizes.classes[0];
+	struct rte_mbuf *pkt = rte_pktmbuf_alloc(pktmbuf_pools_tx[0]);
+	if(pkt == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the benchmark packet.\n");
+	}
+
+	uint64_t t0 = rte_rdtsc_precise();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		fill(bench_flows[i & (BENCH_FLOWS - 1)], size_class, pkt);
+	}
+	uint64_t t1 = rte_rdtsc_precise();
+	rte_pktmbuf_free(pkt);
+
+	return ((double) (t1 - t0))/BENCH_ITERATIONS;
+}
+
+// Record a response of the queue 0 (a new sequence number of the flow each time)
+static double bench_process_rx_pkt() {
+	const size_class_t *size_class = &phases[0].sizes.classes[0];
+	struct rte_mbuf *pkts[BENCH_FLOWS];
+	if(rte_pktmbuf_alloc_bulk(pktmbuf_pools_tx[0], pkts, BENCH_FLOWS) != 0) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the benchmark packets.\n");
+	}
+
+	// responses with a plausible RTT
+	uint64_t now = rte_rdtsc();
+	for(uint32_t i = 0; i < BENCH_FLOWS; i++) {
+		fill_udp_packet(bench_flows[i], size_class, pkts[i]);
+		fill_payload_pkt(pkts[i], 0, now);
+		fill_payload_pkt(pkts[i], 1, now + 10 * TICKS_PER_US);
+	}
+
+	rx_context_t ctx;
+	init_rx_context(&ctx, 0);
+	uint64_t t0 = rte_rdtsc_precise();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		struct rte_mbuf *pkt = pkts[i & (BENCH_FLOWS - 1)];
+		fill_payload_pkt(pkt, 2, bench_flows[i & (BENCH_FLOWS - 1)] | ((uint64_t) (i / BENCH_FLOWS) << 32));
+		process_rx_pkt(pkt, &ctx);
+	}
+	uint64_t t1 = rte_rdtsc_precise();
+	rte_pktmbuf_free_bulk(pkts, BENCH_FLOWS);
+
+	return bench_ns(t1 - t0, BENCH_ITERATIONS);
+}
+
+// Draw an exponential interarrival gap
+static double bench_sample() {
+	uint64_t rng = rng_seed(SEED, 0);
+	double sum = 0;
+
+	uint64_t t0 = rte_rdtsc_precise();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		sum += sample(1.0, &rng);
+	}
+	uint64_t t1 = rte_rdtsc_precise();
+	bench_sink = sum;
+
+	return bench_ns(t1 - t0, BENCH_ITERATIONS);
+}
+
+// Choose the flow of a packet with the alias sampler of the queue 0 (-p)
+static double bench_next_flow() {
+	uint64_t sum = 0;
+
+	uint64_t t0 = rte_rdtsc_precise();
+	for(uint32_t i = 0; i < BENCH_ITERATIONS; i++) {
+		sum += next_flow(flow_dists[0]);
+	}
+	uint64_t t1 = rte_rdtsc_precise();
+	bench_sink = sum;
+
+	return bench_ns(t1 - t0, BENCH_ITERATIONS);
+}
+
+// Clear the counters, the sequence numbers and the histograms of every queue before a run (the microbenchmarks use them too)
+static void bench_reset() {
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		uint64_t nr_queue_flows = (nr_flows - i + nr_queues - 1)/nr_queues;
+		memset(&tx_stats[i], 0, sizeof(tx_stats_t));
+		memset(&rx_stats[i], 0, sizeof(rx_stats_t));
+		memset(tx_seqs[i], 0, nr_queue_flows * sizeof(uint32_t));
+		memset(seq_states[i], 0, nr_queue_flows * sizeof(seq_state_t));
+		for(uint32_t s = 0; s < nr_hist_slots(); s++) {
+			hist_reset(&latency_hists[i][s]);
+		}
+		for(uint32_t p = 0; p < nr_phases; p++) {
+			hist_reset(&warmup_hists[i][p]);
+		}
+		hist_reset(&send_late_hists[i][0]);
+		hist_reset(&send_early_hists[i][0]);
+		hist_reset(&never_sent_hists[i][0]);
+	}
+}
+
+// Free the packets left in the RX queues of the NICs (the next run must not receive them)
+static void bench_drain() {
+	struct rte_mbuf *pkts[BURST_SIZE];
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		uint16_t nb_rx;
+		while((nb_rx = rte_eth_rx_burst(lcore_params[i].portid, lcore_params[i].port_qid, pkts, BURST_SIZE)) > 0) {
+			rte_pktmbuf_free_bulk(pkts, nb_rx);
+		}
+	}
+}
+
+// Run the TX and RX cores at the rate (uniform gaps) for BENCH_RUN_S seconds
+static void bench_run(uint64_t rate, bench_run_t *run) {
+	bench_reset();
+
+	phases[0].rate = rate;
+	phases[0].duration = BENCH_RUN_S;
+	phases[0].warmup = 0;
+	phases[0].distribution = UNIFORM_VALUE;
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		reset_interarrival_gen(interarrival_gens[i], UNIFORM_VALUE, rate);
+	}
+
+	quit_rx = 0;
+	quit_tx = 0;
+	quit_rx_ring = 0;
+	start_phases(rte_rdtsc() + START_DELAY_US * TICKS_PER_US);
+	launch_workers();
+
+	// the responses in flight arrive after the end of the phase
+	while(rte_rdtsc() < phases[0].end_tsc + BENCH_DRAIN_MS * 1000 * TICKS_PER_US) { }
+	quit_rx = 1;
+	quit_tx = 1;
+	quit_rx_ring = 1;
+
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH_WORKER(lcore_id) {
+		rte_eal_wait_lcore(lcore_id);
+	}
+	bench_drain();
+
+	memset(run, 0, sizeof(bench_run_t));
+	run->rate = rate;
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		run->nr_sent += tx_stats[i].nr_pkts;
+		run->nr_late += tx_stats[i].nr_never_sent + tx_stats[i].nr_caught_up + tx_stats[i].nr_shifts;
+		run->nr_received += rx_stats[i].nr_pkts;
+	}
+
+	printf("rate %lu pps: %lu sent, %lu late, %lu received\n", rate, run->nr_sent, run->nr_late, run->nr_received);
+}
+
+// The rate is sustained if no packet was late (nor lost on a device that loops the packets back)
+static int bench_sustained(uint64_t rate, uint8_t loopback) {
+	bench_run_t run;
+	bench_run(rate, &run);
+
+	return run.nr_late == 0 && (!loopback || run.nr_received == run.nr_sent);
+}
+
+// Highest total rate sustained: doubled until it fails, then bisected
+static uint64_t bench_max_rate(uint32_t nr_tx_lcores, uint8_t loopback) {
+	uint64_t good = 0;
+	uint64_t bad = 0;
+	for(uint64_t rate = BENCH_START_RATE * nr_tx_lcores; rate <= BENCH_MAX_RATE; rate *= 2) {
+		if(!bench_sustained(rate, loopback)) {
+			bad = rate;
+			break;
+		}
+		good = rate;
+	}
+	if(bad == 0) {
+		return good;
+	}
+
+	for(uint32_t i = 0; i < BENCH_SEARCH_STEPS; i++) {
+		uint64_t rate = (good + bad)/2;
+		if(bench_sustained(rate, loopback)) {
+			good = rate;
+		} else {
+			bad = rate;
+		}
+	}
+
+	return good;
+}
+
+// main function
+int main(int argc, char **argv) {
+	// init EAL
+	int ret = rte_eal_init(argc, argv);
+	if(ret < 0) {
+		rte_exit(EXIT_FAILURE, "Invalid EAL parameters\n");
+	}
+	argc -= ret;
+	argv += ret;
+
+	// the generator parameters (the rate, the schedule and the duration are chosen by the benchmark)
+	ret = app_parse_args(argc, argv);
+	if(ret < 0) {
+		rte_exit(EXIT_FAILURE, "Invalid arguments\n");
+	}
+	if(capture_mode || outstanding || replay_file[0] || nr_phases > 1) {
+		rte_exit(EXIT_FAILURE, "The benchmark cannot be used with -P, -L, -S or -T.\n");
+	}
+
+	// the same setup as the generator, without the rte_flows (virtual devices have none)
+	init_DPDK();
+	create_latency_hists();
+	create_seq_states();
+	create_flow_dists();
+	create_size_dists();
+	create_interarrival_gens(UNIFORM_VALUE, BENCH_FLOOR_RATE);
+	init_flow_table();
+	create_tx_mempool();
+	if(!rx_rtc_mode) {
+		create_dpdk_rings();
+	}
+	if(!lcore_map_set) {
+		assign_default_lcores();
+	}
+	print_lcore_map();
+
+	uint32_t nr_tx_lcores = 0;
+	for(uint32_t lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		nr_tx_lcores += (lcore_roles[lcore_id].role == ROLE_TX);
+	}
+
+	FILE *fp = output_file[0] ? fopen(output_file, "w") : stdout;
+	if(fp == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot open the output file %s\n", output_file);
+	}
+	fprintf(fp, "version %s\n", BENCH_VERSION);
+	fprintf(fp, "flows %lu\n", nr_flows);
+	fprintf(fp, "queues %lu\n", nr_queues);
+	fprintf(fp, "tx_lcores %u\n", nr_tx_lcores);
+
+	// microbenchmarks on the main core
+	printf("\nMicrobenchmarks:\n");
+	for(uint32_t i = 0; i < BENCH_FLOWS; i++) {
+		bench_flows[i] = next_flow(flow_dists[0]);
+	}
+	// the fill path against the one that wrote every field and payload byte
+	double fill_cycles = bench_fill(fill_udp_packet);
+	double fill_fields_cycles = bench_fill(fill_udp_packet_fields);
+	fprintf(fp, "fill_udp_packet_ns %.2f\n", bench_ns(fill_cycles, 1));
+	fprintf(fp, "fill_udp_packet_cycles %.1f\n", fill_cycles);
+	fprintf(fp, "fill_udp_packet_fields_ns %.2f\n", bench_ns(fill_fields_cycles, 1));
+	fprintf(fp, "fill_udp_packet_fields_cycles %.1f\n", fill_fields_cycles);
+	fprintf(fp, "process_rx_pkt_ns %.2f\n", bench_process_rx_pkt());
+	fprintf(fp, "sample_ns %.2f\n", bench_sample());
+	fprintf(fp, "next_flow_ns %.2f\n", bench_next_flow());
+	fflush(fp);
+
+	// the RTT floor at a low rate, if the device loops the packets back (net_ring)
+	printf("\nRTT floor:\n");
+	bench_run_t run;
+	bench_run(BENCH_FLOOR_RATE, &run);
+	uint8_t loopback = (run.nr_received > 0);
+	if(loopback) {
+		histogram_t *floor_hist = hist_create("bench_floor");
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			for(uint32_t s = 0; s < nr_hist_slots(); s++) {
+				hist_merge(floor_hist, &latency_hists[i][s]);
+			}
+		}
+		double ticks_per_ns = (double)TICKS_PER_US/1000;
+		fprintf(fp, "rtt_floor_min_ns %.0f\n", floor_hist->min/ticks_per_ns);
+		fprintf(fp, "rtt_floor_p50_ns %.0f\n", hist_percentile(floor_hist, 50)/ticks_per_ns);
+		fprintf(fp, "rtt_floor_p99_ns %.0f\n", hist_percentile(floor_hist, 99)/ticks_per_ns);
+		fprintf(fp, "rtt_floor_p999_ns %.0f\n", hist_percentile(floor_hist, 99.9)/ticks_per_ns);
+		rte_free(floor_hist);
+	} else {
+		printf("No response received, the device does not loop the packets back (RTT floor skipped)\n");
+	}
+	fflush(fp);
+
+	// the highest rate without late packets (nor losses with a loopback)
+	printf("\nMaximum rate:\n");
+	uint64_t max_rate = bench_max_rate(nr_tx_lcores, loopback);
+	fprintf(fp, "max_pps %lu\n", max_rate);
+	fprintf(fp, "max_pps_per_tx_lcore %lu\n", max_rate/nr_tx_lcores);
+
+	if(fp != stdout) {
+		fclose(fp);
+	}
+
+	// clean up
+	clean_heap();
+	clean_hugepages();
+
+	return 0;
+}
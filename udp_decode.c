@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "output_format.h"
+
+#define CHUNK_RECORDS					65536
+
+// Compare two buckets by value (for qsort function)
+static int cmp_bucket(const void *a, const void *b) {
+	uint64_t va = ((const output_bucket_hw_t*) a)->value;
+	uint64_t vb = ((const output_bucket_hw_t*) b)->value;
+
+	return (va > vb) - (va < vb);
+}
+
+// Read and check the header of a binary output file
+static FILE *open_output(const char *filename, output_header_t *header) {
+	FILE *fp = fopen(filename, "rb");
+	if(fp == NULL) {
+		fprintf(stderr, "Cannot open %s.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	if(fread(header, sizeof(output_header_t), 1, fp) != 1 || header->magic != OUTPUT_MAGIC || header->version != OUTPUT_VERSION) {
+		fprintf(stderr, "%s is not a udp-generator binary output.\n", filename);
+		exit(EXIT_FAILURE);
+	}
+
+	return fp;
+}
+
+// Print all RTT samples as the text output
+static void decode_capture(FILE *fp, const output_header_t *header, FILE *out) {
+	static output_capture_hw_t records[CHUNK_RECORDS];
+	double ticks_per_ns = (double)header->ticks_per_us/1000;
+	int hw = (header->type == OUTPUT_TYPE_CAPTURE_HW);
+
+	uint64_t remaining = header->nr_records;
+	while(remaining) {
+		uint64_t n = remaining < CHUNK_RECORDS ? remaining : CHUNK_RECORDS;
+		for(uint64_t i = 0; i < n; i++) {
+			size_t size = hw ? sizeof(output_capture_hw_t) : sizeof(output_capture_t);
+			if(fread(&records[i], size, 1, fp) != 1) {
+				fprintf(stderr, "Truncated file (queue %u).\n", header->queue);
+				exit(EXIT_FAILURE);
+			}
+		}
+
+		for(uint64_t i = 0; i < n; i++) {
+			if(hw) {
+				fprintf(out, "%u\t%lu\t%lu\n", records[i].flow_id, ((uint64_t)(records[i].rtt/ticks_per_ns)), ((uint64_t)(records[i].hw_rtt/ticks_per_ns)));
+			} else {
+				fprintf(out, "%u\t%lu\n", records[i].flow_id, ((uint64_t)(records[i].rtt/ticks_per_ns)));
+			}
+		}
+		remaining -= n;
+	}
+}
+
+// Append the buckets of a file to the array (hw_count is 0 without hardware timestamps)
+static output_bucket_hw_t *read_buckets(FILE *fp, const output_header_t *header, output_bucket_hw_t *buckets, uint64_t *nr_buckets) {
+	buckets = realloc(buckets, (*nr_buckets + header->nr_records) * sizeof(output_bucket_hw_t));
+	if(buckets == NULL) {
+		fprintf(stderr, "Cannot alloc the buckets.\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for(uint64_t i = 0; i < header->nr_records; i++) {
+		output_bucket_hw_t *bucket = &buckets[*nr_buckets + i];
+		size_t size = (header->type == OUTPUT_TYPE_HISTOGRAM_HW) ? sizeof(output_bucket_hw_t) : sizeof(output_bucket_t);
+		bucket->hw_count = 0;
+		if(fread(bucket, size, 1, fp) != 1) {
+			fprintf(stderr, "Truncated file (queue %u).\n", header->queue);
+			exit(EXIT_FAILURE);
+		}
+	}
+	*nr_buckets += header->nr_records;
+
+	return buckets;
+}
+
+// Convert the binary output files of all queues to the text output
+int main(int argc, char **argv) {
+	if(argc < 2) {
+		fprintf(stderr, "%s FILE...\n"
+			"  converts the binary output of every queue (<output>.<queue>) to the text output on stdout\n"
+			"  (with a schedule, decode the files of one phase at a time: <output>.p<phase>.<queue>)\n",
+			argv[0]
+		);
+		return EXIT_FAILURE;
+	}
+
+	int type = -1;
+	uint32_t phase = 0;
+	uint64_t ticks_per_us = 0;
+	uint64_t nr_buckets = 0;
+	output_bucket_hw_t *buckets = NULL;
+	for(int i = 1; i < argc; i++) {
+		output_header_t header;
+		FILE *fp = open_output(argv[i], &header);
+
+		if(type == -1) {
+			type = header.type;
+			phase = header.phase;
+			ticks_per_us = header.ticks_per_us;
+		} else if(type != header.type || ticks_per_us != header.ticks_per_us) {
+			fprintf(stderr, "%s does not belong to the same run.\n", argv[i]);
+			return EXIT_FAILURE;
+		} else if(phase != header.phase) {
+			fprintf(stderr, "%s does not belong to the same phase.\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+
+		if(header.type == OUTPUT_TYPE_CAPTURE || header.type == OUTPUT_TYPE_CAPTURE_HW) {
+			decode_capture(fp, &header, stdout);
+		} else {
+			buckets = read_buckets(fp, &header, buckets, &nr_buckets);
+		}
+
+		fclose(fp);
+	}
+
+	// merge the histograms of all queues (same value means same bucket)
+	if(type == OUTPUT_TYPE_HISTOGRAM || type == OUTPUT_TYPE_HISTOGRAM_HW) {
+		double ticks_per_ns = (double)ticks_per_us/1000;
+		qsort(buckets, nr_buckets, sizeof(output_bucket_hw_t), cmp_bucket);
+		for(uint64_t i = 0; i < nr_buckets; ) {
+			uint64_t value = buckets[i].value;
+			uint64_t count = 0;
+			uint64_t hw_count = 0;
+			for(; i < nr_buckets && buckets[i].value == value; i++) {
+				count += buckets[i].count;
+				hw_count += buckets[i].hw_count;
+			}
+			if(type == OUTPUT_TYPE_HISTOGRAM_HW) {
+				printf("%lu\t%lu\t%lu\n", (uint64_t)(value/ticks_per_ns), count, hw_count);
+			} else {
+				printf("%lu\t%lu\n", (uint64_t)(value/ticks_per_ns), count);
+			}
+		}
+	}
+
+	free(buckets);
+
+	return 0;
+}
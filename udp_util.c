@@ -1,103 +1,218 @@
 #include "udp_util.h"
 
-// Shuffle the UDP source port array
-void shuffle(uint16_t* arr, uint32_t n) {
+// Shuffle the array of source tuple indexes
+void shuffle(uint32_t* arr, uint32_t n) {
 	if(n < 2) {
 		return;
 	}
 
 	for(uint32_t i = 0; i < n - 1; i++) {
 		uint32_t j = i + rte_rand() / (UINT64_MAX / (n - i) + 1);
-		uint16_t tmp = arr[j];
+		uint32_t tmp = arr[j];
 		arr[j] = arr[i];
 		arr[i] = tmp;
 	}
 }
 
-// Create and initialize the Control Blocks for all flows
-void init_blocks() {
-	// allocate the all control block structure previosly
-	control_blocks = (control_block_t *) rte_zmalloc("control_blocks", nr_flows * sizeof(control_block_t), RTE_CACHE_LINE_SIZE);
-
-	// choose UDP source port for all flows
-	uint16_t src_udp_port;
-	uint16_t ports[nr_flows];
-	for(uint32_t i = 0; i < nr_flows; i++) {
-		ports[i] = rte_cpu_to_be_16((i % (nr_flows/nr_servers)) + 1);
-	}
-
-	// shuffle port array
-	shuffle(ports, nr_flows);
-
-	for(uint32_t i = 0; i < nr_flows; i++) {
-		src_udp_port = ports[i];
-
-		control_blocks[i].src_addr = src_ipv4_addr;
-		control_blocks[i].dst_addr = dst_ipv4_addr;
-
-		control_blocks[i].src_port = src_udp_port;
-		control_blocks[i].dst_port = rte_cpu_to_be_16(dst_udp_port + (i % nr_servers));
-
-		control_blocks[i].flow_mark_action.id = i;
-		control_blocks[i].flow_queue_action.index = i % nr_queues;
-		control_blocks[i].flow_eth.type = ETH_IPV4_TYPE_NETWORK;
-		control_blocks[i].flow_eth_mask.type = 0xFFFF;
-		control_blocks[i].flow_ipv4.hdr.src_addr = control_blocks[i].dst_addr;
-		control_blocks[i].flow_ipv4.hdr.dst_addr = control_blocks[i].src_addr;
-		control_blocks[i].flow_ipv4_mask.hdr.src_addr = 0xFFFFFFFF;
-		control_blocks[i].flow_ipv4_mask.hdr.dst_addr = 0xFFFFFFFF;
-		control_blocks[i].flow_udp.hdr.src_port = control_blocks[i].dst_port;
-		control_blocks[i].flow_udp.hdr.dst_port = control_blocks[i].src_port;
-		control_blocks[i].flow_udp_mask.hdr.src_port = 0xFFFF;
-		control_blocks[i].flow_udp_mask.hdr.dst_port = 0xFFFF;
-	}
-}
-
-// Fill the UDP packets from Control Block data
-void fill_udp_packet(uint16_t i, struct rte_mbuf *pkt) {
-	// get control block for the flow
-	control_block_t *block = &control_blocks[i];
-
-	// ensure that IP/UDP checksum offloadings
-	pkt->ol_flags |= (RTE_MBUF_F_TX_IPV4 | RTE_MBUF_F_TX_IP_CKSUM | RTE_MBUF_F_TX_UDP_CKSUM);
-
+// Build the Ethernet/IPv4/UDP header template of a backend
+static void build_hdr_template(backend_t *backend, port_t *port) {
 	// fill Ethernet information
-	struct rte_ether_hdr *eth_hdr = (struct rte_ether_hdr *) rte_pktmbuf_mtod(pkt, struct ether_hdr*);
-	eth_hdr->dst_addr = dst_eth_addr;
-	eth_hdr->src_addr = src_eth_addr;
+	struct rte_ether_hdr *eth_hdr = (struct rte_ether_hdr *) backend->hdr_template;
+	eth_hdr->dst_addr = backend->dst_eth_addr;
+	eth_hdr->src_addr = port->src_eth_addr;
 	eth_hdr->ether_type = ETH_IPV4_TYPE_NETWORK;
 
 	// fill IPv4 information
-	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	struct rte_ipv4_hdr *ipv4_hdr = (struct rte_ipv4_hdr *) (backend->hdr_template + sizeof(struct rte_ether_hdr));
 	ipv4_hdr->version_ihl = 0x45;
-	ipv4_hdr->total_length = rte_cpu_to_be_16(frame_size - sizeof(struct rte_ether_hdr));
+	ipv4_hdr->total_length = rte_cpu_to_be_16(max_frame_size - sizeof(struct rte_ether_hdr));
 	ipv4_hdr->time_to_live = 255;
 	ipv4_hdr->packet_id = 0;
 	ipv4_hdr->next_proto_id = IPPROTO_UDP;
 	ipv4_hdr->fragment_offset = 0;
-	ipv4_hdr->src_addr = block->src_addr;
-	ipv4_hdr->dst_addr = block->dst_addr;
+	ipv4_hdr->src_addr = port->src_ipv4_addr;
+	ipv4_hdr->dst_addr = backend->dst_ipv4_addr;
 	ipv4_hdr->hdr_checksum = 0;
 
 	// fill UDP information
-	struct rte_udp_hdr *udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
-	udp_hdr->dst_port = block->dst_port;
-	udp_hdr->src_port = block->src_port;
-	udp_hdr->dgram_len = rte_cpu_to_be_16(sizeof(struct rte_udp_hdr) + udp_payload_size);
+	struct rte_udp_hdr *udp_hdr = (struct rte_udp_hdr *) (backend->hdr_template + sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+	udp_hdr->dst_port = rte_cpu_to_be_16(backend->dst_udp_port);
+	udp_hdr->src_port = rte_cpu_to_be_16(port->src_udp_port);
+	udp_hdr->dgram_len = rte_cpu_to_be_16(max_frame_size - sizeof(struct rte_ether_hdr) - sizeof(struct rte_ipv4_hdr));
 	udp_hdr->dgram_cksum = 0;
+}
 
-	// fill the payload of the packet
-	uint8_t *payload = ((uint8_t*)udp_hdr) + sizeof(struct rte_udp_hdr);
-	fill_udp_payload(payload, udp_payload_size);
+// Assign the flows of each port to its backends by weight (smooth weighted round-robin over the flows of each queue in turn,
+// so the shares follow the weights closely and every queue sends to every backend)
+static void assign_backends() {
+	double current[MAX_BACKENDS] = {0};
+	for(uint32_t q = 0; q < nr_queues; q++) {
+		uint32_t port = q / nr_queues_per_port;
+		for(uint32_t i = q; i < nr_flows; i += nr_queues) {
+			double total = 0;
+			uint32_t chosen = MAX_BACKENDS;
+			for(uint32_t b = 0; b < nr_backends; b++) {
+				if(backends[b].port != port) {
+					continue;
+				}
+				current[b] += backends[b].weight;
+				total += backends[b].weight;
+				if(chosen == MAX_BACKENDS || current[b] > current[chosen]) {
+					chosen = b;
+				}
+			}
+			current[chosen] -= total;
+			flow_backends[i] = chosen;
+			backends[chosen].nr_flows++;
+		}
+	}
+}
+
+// Give a distinct source address and port to every flow of each port (in a random order over the ranges of the port)
+static void assign_tuples() {
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		port_t *port = &ports[p];
+		uint64_t nr_port_flows = 0;
+		for(uint32_t q = p * nr_queues_per_port; q < (p + 1) * nr_queues_per_port; q++) {
+			nr_port_flows += (nr_flows - q + nr_queues - 1)/nr_queues;
+		}
+		if(nr_port_flows > (uint64_t) port->nr_src_ipv4_addrs * port->nr_src_udp_ports) {
+			rte_exit(EXIT_FAILURE, "The port %u has %lu flows but only %u source addresses x %u source ports.\n",
+				port->portid, nr_port_flows, port->nr_src_ipv4_addrs, port->nr_src_udp_ports);
+		}
+
+		// index of the source tuple of each flow of the port
+		uint32_t *tuples = (uint32_t *) rte_malloc("tuples", nr_port_flows * sizeof(uint32_t), 0);
+		if(tuples == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot alloc the source tuples.\n");
+		}
+		for(uint32_t j = 0; j < nr_port_flows; j++) {
+			tuples[j] = j;
+		}
+		shuffle(tuples, nr_port_flows);
+
+		uint32_t j = 0;
+		uint32_t first_addr = rte_be_to_cpu_32(port->src_ipv4_addr);
+		for(uint32_t i = 0; i < nr_flows; i++) {
+			if(flow_port(i) != port) {
+				continue;
+			}
+
+			flow_tuple_t *tuple = &flow_tuples[i];
+			tuple->src_addr = rte_cpu_to_be_32(first_addr + tuples[j] / port->nr_src_udp_ports);
+			tuple->src_port = rte_cpu_to_be_16(port->src_udp_port + tuples[j] % port->nr_src_udp_ports);
+			tuple->dst_port = rte_cpu_to_be_16(backends[flow_backends[i]].dst_udp_port + (i % nr_servers));
+			j++;
+		}
+
+		rte_free(tuples);
+	}
+}
 
-	// fill the packet size
-	pkt->data_len = frame_size;
+// Create the flow table on hugepages: an array of 8-byte tuples (source address and ports, all written together in each
+// packet) and an array of the backends of the flows (read apart by the per-backend counters)
+void init_flow_table() {
+	flow_tuples = (flow_tuple_t *) rte_zmalloc("flow_tuples", nr_flows * sizeof(flow_tuple_t), RTE_CACHE_LINE_SIZE);
+	flow_backends = (uint8_t *) rte_zmalloc("flow_backends", nr_flows * sizeof(uint8_t), RTE_CACHE_LINE_SIZE);
+	if(flow_tuples == NULL || flow_backends == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot alloc the flow table.\n");
+	}
+
+	// the requests in flight are written by the TX core of each queue, so every queue has its own array
+	if(outstanding) {
+		for(uint32_t q = 0; q < nr_queues; q++) {
+			uint64_t nr_queue_flows = (nr_flows - q + nr_queues - 1)/nr_queues;
+			flow_requests[q] = (request_t *) rte_zmalloc_socket("flow_requests", nr_queue_flows * outstanding * sizeof(request_t), RTE_CACHE_LINE_SIZE, queue_socket(q));
+			if(flow_requests[q] == NULL) {
+				rte_exit(EXIT_FAILURE, "Cannot alloc the requests in flight.\n");
+			}
+		}
+	}
+
+	// choose the backend and the source address and port of every flow
+	assign_backends();
+	assign_tuples();
+
+	// build the header templates used by the TX
+	for(uint32_t b = 0; b < nr_backends; b++) {
+		build_hdr_template(&backends[b], &ports[backends[b].port]);
+	}
+
+	// the TX mbufs of a port keep the headers of its first backend, they are copied per packet only with several backends
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		uint32_t nr_port_backends = 0;
+		for(uint32_t b = nr_backends; b-- > 0;) {
+			if(backends[b].port == p) {
+				ports[p].pool_backend = b;
+				nr_port_backends++;
+			}
+		}
+		ports[p].pool_hdr = (nr_port_backends == 1);
+	}
+}
+
+// Free the flow table
+void clean_flow_table() {
+	rte_free(flow_tuples);
+	rte_free(flow_backends);
+	for(uint32_t q = 0; q < nr_queues; q++) {
+		rte_free(flow_requests[q]);
+	}
+}
+
+// Compute the header lengths of a frame size once
+void init_size_class(size_class_t *sc, uint32_t frame_size) {
+	sc->frame_size = frame_size;
+	sc->ip_total_length = rte_cpu_to_be_16(frame_size - sizeof(struct rte_ether_hdr));
+	sc->udp_dgram_len = rte_cpu_to_be_16(frame_size - sizeof(struct rte_ether_hdr) - sizeof(struct rte_ipv4_hdr));
+}
+
+// Fill the UDP packets from the flow table
+void fill_udp_packet(uint32_t i, const size_class_t *sc, struct rte_mbuf *pkt) {
+	// get the addresses of the flow
+	const flow_tuple_t *tuple = &flow_tuples[i];
+	const backend_t *backend = &backends[flow_backends[i]];
+	const port_t *port = &ports[backend->port];
+
+	// ensure that IP/UDP checksum offloadings (those supported by the port)
+	pkt->ol_flags |= port->tx_ol_flags;
+
+	// the headers of a single backend and the payload were filled when the pool was created, else copy the headers of the backend
+	if(unlikely(!port->pool_hdr)) {
+		rte_memcpy(rte_pktmbuf_mtod(pkt, uint8_t*), backend->hdr_template, PKT_HDR_SIZE);
+	}
+
+	// fill the addresses of the flow and the packet size
+	struct rte_ipv4_hdr *ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
+	ipv4_hdr->src_addr = tuple->src_addr;
+	ipv4_hdr->total_length = sc->ip_total_length;
+	struct rte_udp_hdr *udp_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_udp_hdr *, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr));
+	udp_hdr->src_port = tuple->src_port;
+	udp_hdr->dst_port = tuple->dst_port;
+	udp_hdr->dgram_len = sc->udp_dgram_len;
+
+	// compute the IPv4 checksum if the port cannot (the mbuf may still have the one of its previous packet)
+	if(unlikely(port->sw_ip_cksum)) {
+		ipv4_hdr->hdr_checksum = 0;
+		ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+	}
+	pkt->data_len = sc->frame_size;
 	pkt->pkt_len = pkt->data_len;
 }
 
 // Fill the payload of the UDP packet
 void fill_udp_payload(uint8_t *payload, uint32_t length) {
-	for(uint32_t i = 0; i < length; i++) {
-		payload[i] = 'A';
-	}
+	memset(payload, 'A', length);
+}
+
+// Initialize the constant part of every TX mbuf once (callback for rte_mempool_obj_iter)
+void init_tx_pkt(struct rte_mempool *mp, void *opaque, void *obj, unsigned obj_idx) {
+	struct rte_mbuf *pkt = (struct rte_mbuf *) obj;
+	const port_t *port = (const port_t *) opaque;
+
+	// the headers of the first backend of the port (only the addresses and ports of the flow are written per packet)
+	rte_memcpy(rte_pktmbuf_mtod(pkt, uint8_t*), backends[port->pool_backend].hdr_template, PKT_HDR_SIZE);
+
+	// fill the payload of the packet (for the biggest frame size of the run)
+	fill_udp_payload(rte_pktmbuf_mtod_offset(pkt, uint8_t*, PKT_HDR_SIZE), max_frame_size - PKT_HDR_SIZE);
 }
@@ -2,6 +2,7 @@
 #define __UDP_UTIL_H__
 
 #include <stdint.h>
+#include <string.h>
 
 #include <rte_ip.h>
 #include <rte_eal.h>
@@ -14,46 +15,130 @@
 #include <rte_atomic.h>
 #include <rte_ethdev.h>
 #include <rte_malloc.h>
+#include <rte_memcpy.h>
 #include <rte_mempool.h>
 
-// Control Block
-typedef struct control_block_s {
-	// used only by the TX
-	uint32_t 						src_addr;
-	uint32_t 						dst_addr;
+#define ETH_IPV4_TYPE_NETWORK		0x0008
+#define PKT_HDR_SIZE				(sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr))
+#define MAX_BACKENDS				64
+
+// Addresses of a flow that differ from the header template of its backend (in network order, 8 bytes)
+typedef struct flow_tuple_s {
+	uint32_t						src_addr;
 	uint16_t						src_port;
 	uint16_t						dst_port;
+} flow_tuple_t;
 
-	// used only in the beginning
-	struct rte_flow_item_eth		flow_eth;
-	struct rte_flow_item_eth		flow_eth_mask;
-	struct rte_flow_item_ipv4		flow_ipv4;
-	struct rte_flow_item_ipv4		flow_ipv4_mask;
-	struct rte_flow_item_udp		flow_udp;
-	struct rte_flow_item_udp		flow_udp_mask;
-	struct rte_flow_action_mark 	flow_mark_action;
-	struct rte_flow_action_queue 	flow_queue_action;
+// Request in flight of a flow in closed-loop (kept per queue, only its TX core writes it, a free slot has no tsc)
+typedef struct request_s {
+	uint64_t						tsc;
+	uint32_t						seq;
+} request_t;
 
-} __rte_cache_aligned control_block_t;
+// Mapping of the NIC clock to the TSC: the NIC time nic0 was read at the TSC tsc0
+typedef struct hw_clock_s {
+	uint64_t						nic0;
+	uint64_t						tsc0;
+	double							ticks_per_nic;
+} hw_clock_t;
 
-#define ETH_IPV4_TYPE_NETWORK		0x0008
+// Port driven by the generator, with its own addressing (and NIC clock for the hardware timestamps)
+typedef struct port_s {
+	uint16_t						portid;
+	int								socket_id;
+	uint16_t						nb_rxd;
+	uint16_t						nb_txd;
+	struct rte_ether_addr			src_eth_addr;
+	struct rte_ether_addr			dst_eth_addr;
+	uint32_t						src_ipv4_addr;
+	uint32_t						nr_src_ipv4_addrs;
+	uint32_t						dst_ipv4_addr;
+	uint16_t						src_udp_port;
+	uint32_t						nr_src_udp_ports;
+	uint16_t						dst_udp_port;
+
+	// TX offloads of the NIC (the IPv4 checksum is computed in software without its offload)
+	uint64_t						tx_ol_flags;
+	uint8_t							sw_ip_cksum;
+
+	// backend whose headers the TX mbufs of the port get when their pool is created (enough for every packet with a single backend)
+	uint32_t						pool_backend;
+	uint8_t							pool_hdr;
+
+	// hardware timestamps delivered by the NIC (RX timestamp, and TX send on timestamp)
+	uint8_t							hw_timestamps;
+	uint8_t							hw_tx_ts;
+
+	// NIC clock mapped to the TSC, recalibrated during the run (the cores read the current one of the two mappings)
+	hw_clock_t						hw_clock[2];
+	volatile uint32_t				hw_clock_cur;
+	double							hw_ticks_per_nic0;
+	double							hw_clock_max_drift;
+	uint32_t						hw_clock_nr_calibrations;
+} port_t;
 
-extern uint16_t dst_udp_port;
-extern uint32_t dst_ipv4_addr;
-extern uint32_t src_ipv4_addr;
-extern struct rte_ether_addr dst_eth_addr;
-extern struct rte_ether_addr src_eth_addr;
+// Backend of a port, it receives the flows of the port in proportion of its weight
+typedef struct backend_s {
+	// Ethernet/IPv4/UDP headers of its flows ready to be copied (the source address and the ports are the flow's)
+	uint8_t							hdr_template[PKT_HDR_SIZE];
+
+	uint32_t						port;			// index in ports[]
+	double							weight;
+	struct rte_ether_addr			dst_eth_addr;
+	uint32_t						dst_ipv4_addr;
+	uint16_t						dst_udp_port;
+	uint32_t						nr_flows;
+} __rte_cache_aligned backend_t;
+
+// Lengths of a frame size (in network order, written over the header template)
+typedef struct size_class_s {
+	uint32_t						frame_size;
+	uint16_t						ip_total_length;
+	uint16_t						udp_dgram_len;
+} size_class_t;
+
+extern port_t ports[RTE_MAX_ETHPORTS];
+extern uint32_t nr_ports;
 
 extern uint64_t nr_flows;
 extern uint64_t nr_queues;
+extern uint64_t nr_queues_per_port;
 extern uint16_t nr_servers;
-extern uint32_t frame_size;
-extern uint32_t udp_payload_size;
-extern struct rte_mempool *pktmbuf_pool;
-extern control_block_t *control_blocks;
+extern uint32_t max_frame_size;
+extern uint32_t outstanding;
+extern struct rte_mempool *pktmbuf_pools[RTE_MAX_LCORE];
+extern struct rte_mempool *pktmbuf_pools_tx[RTE_MAX_LCORE];
+extern backend_t backends[MAX_BACKENDS];
+extern uint32_t nr_backends;
+extern flow_tuple_t *flow_tuples;
+extern uint8_t *flow_backends;
+extern request_t *flow_requests[RTE_MAX_LCORE];
 
-void init_blocks();
-void fill_udp_packet(uint16_t i, struct rte_mbuf *pkt);
+void init_flow_table();
+void clean_flow_table();
+void init_size_class(size_class_t *sc, uint32_t frame_size);
+void fill_udp_packet(uint32_t i, const size_class_t *sc, struct rte_mbuf *pkt);
 void fill_udp_payload(uint8_t *payload, uint32_t length);
+void init_tx_pkt(struct rte_mempool *mp, void *opaque, void *obj, unsigned obj_idx);
+
+// Port of a queue (the queues of all ports are numbered one after the other)
+static inline port_t *queue_port(uint32_t qid) {
+	return &ports[qid / nr_queues_per_port];
+}
+
+// NUMA socket of the NIC of a queue (where its pools, rings, arrays and cores should be)
+static inline int queue_socket(uint32_t qid) {
+	return queue_port(qid)->socket_id;
+}
+
+// Port of a flow (the port of the queue that owns the flow)
+static inline port_t *flow_port(uint32_t flow_id) {
+	return queue_port(flow_id % nr_queues);
+}
+
+// Requests in flight of a flow in closed-loop (the outstanding slots of the flow, in the array of the queue that owns it)
+static inline request_t *flow_request_slots(uint32_t flow_id) {
+	return &flow_requests[flow_id % nr_queues][(uint64_t) (flow_id / nr_queues) * outstanding];
+}
 
 #endif // __UDP_UTIL_H__
@@ -1,14 +1,98 @@
 #include "util.h"
+#include "dpdk_util.h"
+#include "replay_util.h"
 
-int distribution;
+static int distribution;
+static char size_spec[MAXSTRLEN];
+static char schedule_file[MAXSTRLEN];
+static char lcore_map_spec[8 * MAXSTRLEN];
+uint8_t binary_output;
 char output_file[MAXSTRLEN];
 
-// Sample the value using Exponential Distribution
-double sample(double lambda) {
-   	double u = ((double) rte_rand()) / ((uint64_t) -1);
+// Application parameters
+uint64_t rate;
+uint64_t duration;
+uint64_t nr_flows;
+uint64_t nr_queues;
+uint64_t nr_queues_per_port;
+uint16_t nr_servers;
+uint32_t min_lcores;
+uint32_t max_frame_size;
+uint64_t burst_window_ns;
+uint8_t late_policy = LATE_DROP;
+uint64_t late_threshold_us = LATE_THRESHOLD_US;
+uint64_t report_interval_ms;
+uint8_t rx_rtc_mode;
+uint32_t outstanding;
+uint8_t soft_demux;
 
-	return -log(1 - u) / lambda;
-}
+// Rate schedule
+phase_t phases[MAX_PHASES];
+uint32_t nr_phases;
+
+// Hardware timestamps
+uint8_t hw_timestamps;
+int hw_rx_ts_offset = -1;
+uint64_t hw_rx_ts_flag;
+int hw_tx_ts_offset = -1;
+uint64_t hw_tx_ts_flag;
+
+// General variables
+uint64_t TICKS_PER_US;
+flow_dist_t *flow_dists[RTE_MAX_LCORE];
+interarrival_gen_t *interarrival_gens[RTE_MAX_LCORE];
+
+// Heap and DPDK allocated
+uint8_t capture_mode;
+histogram_t *latency_hists[RTE_MAX_LCORE];
+histogram_t *warmup_hists[RTE_MAX_LCORE];
+histogram_t *hw_latency_hists[RTE_MAX_LCORE];
+histogram_t *send_late_hists[RTE_MAX_LCORE];
+histogram_t *send_early_hists[RTE_MAX_LCORE];
+histogram_t *never_sent_hists[RTE_MAX_LCORE];
+uint32_t *tx_seqs[RTE_MAX_LCORE];
+seq_state_t *seq_states[RTE_MAX_LCORE];
+node_t **incoming_array;
+uint64_t *incoming_idx_array;
+struct rte_mempool *pktmbuf_pools[RTE_MAX_LCORE];
+struct rte_mempool *pktmbuf_pools_tx[RTE_MAX_LCORE];
+
+// Flow table and backends (per-backend counters and latency only with several backends)
+flow_tuple_t *flow_tuples;
+uint8_t *flow_backends;
+request_t *flow_requests[RTE_MAX_LCORE];
+backend_t backends[MAX_BACKENDS];
+uint32_t nr_backends;
+uint8_t backend_stats;
+histogram_t *backend_hists[RTE_MAX_LCORE];
+uint64_t *backend_tx_pkts[RTE_MAX_LCORE];
+uint64_t *backend_rx_pkts[RTE_MAX_LCORE];
+
+// Internal threads variables
+volatile uint8_t quit_rx = 0;
+volatile uint8_t quit_tx = 0;
+volatile uint8_t quit_rx_ring = 0;
+lcore_param lcore_params[RTE_MAX_LCORE];
+lcore_role_t lcore_roles[RTE_MAX_LCORE];
+uint8_t lcore_map_set;
+tx_stats_t tx_stats[RTE_MAX_LCORE];
+rx_stats_t rx_stats[RTE_MAX_LCORE];
+struct rte_ring *rx_rings[RTE_MAX_LCORE];
+struct rte_ring *completion_rings[RTE_MAX_LCORE][RTE_MAX_LCORE];
+
+// Connection variables (defaults of the ports)
+uint16_t dst_udp_port;
+uint16_t src_udp_port = 1;
+uint32_t nr_src_udp_ports = UINT16_MAX;
+uint32_t dst_ipv4_addr;
+uint32_t src_ipv4_addr;
+uint32_t nr_src_ipv4_addrs = 1;
+struct rte_ether_addr dst_eth_addr;
+struct rte_ether_addr src_eth_addr;
+
+// Ports
+port_t ports[RTE_MAX_ETHPORTS];
+uint32_t nr_ports;
 
 // Convert string type into int type
 static uint32_t process_int_arg(const char *arg) {
@@ -17,6 +101,379 @@ static uint32_t process_int_arg(const char *arg) {
 	return strtoul(arg, &end, 10);
 }
 
+// Convert the name of an interarrival distribution (-1 if unknown)
+static int parse_distribution(const char *name) {
+	if(strcmp(name, "uniform") == 0) {
+		return UNIFORM_VALUE;
+	} else if(strcmp(name, "exponential") == 0) {
+		return EXPONENTIAL_VALUE;
+	}
+
+	return -1;
+}
+
+// Parse the lateness policy POLICY[:THRESHOLD] (-1 if invalid)
+static int parse_late_policy(const char *spec) {
+	char name[MAXSTRLEN];
+	snprintf(name, sizeof(name), "%s", spec);
+
+	char *sep = strchr(name, ':');
+	if(sep) {
+		*sep = '\0';
+		late_threshold_us = process_int_arg(sep + 1);
+	}
+
+	if(strcmp(name, "drop") == 0) {
+		late_policy = LATE_DROP;
+	} else if(strcmp(name, "catchup") == 0) {
+		late_policy = LATE_CATCHUP;
+	} else if(strcmp(name, "shift") == 0) {
+		late_policy = LATE_SHIFT;
+	} else {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Names of the roles of the worker cores
+static const char *role_names[] = {"none", "TX", "RX", "RX ring", "replay"};
+
+// Parse the lcore map ROLE:LCORE=FIRST[-LAST][,...] into the roles of the cores (-1 if invalid)
+static int parse_lcore_map(const char *spec) {
+	char map[sizeof(lcore_map_spec)];
+	snprintf(map, sizeof(map), "%s", spec);
+
+	char *save = NULL;
+	for(char *entry = strtok_r(map, ",", &save); entry != NULL; entry = strtok_r(NULL, ",", &save)) {
+		char *lcore = strchr(entry, ':');
+		char *queues = lcore ? strchr(lcore, '=') : NULL;
+		if(queues == NULL) {
+			return -1;
+		}
+		*lcore++ = '\0';
+		*queues++ = '\0';
+
+		uint8_t role;
+		if(strcmp(entry, "tx") == 0) {
+			role = ROLE_TX;
+		} else if(strcmp(entry, "rx") == 0) {
+			role = ROLE_RX;
+		} else if(strcmp(entry, "ring") == 0) {
+			role = ROLE_RX_RING;
+		} else {
+			return -1;
+		}
+
+		uint32_t lcore_id = process_int_arg(lcore);
+		char *sep = strchr(queues, '-');
+		uint32_t first = process_int_arg(queues);
+		uint32_t last = sep ? process_int_arg(sep + 1) : first;
+		if(lcore_id >= RTE_MAX_LCORE || last < first) {
+			return -1;
+		}
+
+		// an lcore may appear in several entries, always with the same role
+		lcore_role_t *conf = &lcore_roles[lcore_id];
+		if(conf->role != ROLE_NONE && conf->role != role) {
+			rte_exit(EXIT_FAILURE, "The lcore %u has several roles in the lcore map.\n", lcore_id);
+		}
+		conf->role = role;
+		for(uint32_t q = first; q <= last; q++) {
+			if(q >= nr_queues) {
+				rte_exit(EXIT_FAILURE, "The queue %u of the lcore map does not exist (%lu queues).\n", q, nr_queues);
+			}
+			if(conf->nr_queues == RTE_MAX_LCORE) {
+				return -1;
+			}
+			conf->qids[conf->nr_queues++] = q;
+		}
+	}
+
+	lcore_map_set = 1;
+
+	return 0;
+}
+
+// Check that the map gives every queue exactly one core of each role on the worker cores of the EAL (returns the number of cores used)
+static uint32_t check_lcore_map() {
+	static uint8_t served[RTE_MAX_LCORE][ROLE_RX_RING + 1];
+	uint32_t nr_lcores = 0;
+
+	for(uint32_t lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		lcore_role_t *conf = &lcore_roles[lcore_id];
+		if(conf->role == ROLE_NONE) {
+			continue;
+		}
+		if(!rte_lcore_is_enabled(lcore_id) || lcore_id == rte_get_main_lcore()) {
+			rte_exit(EXIT_FAILURE, "The lcore %u of the lcore map is not a worker core of the EAL.\n", lcore_id);
+		}
+		if(conf->role == ROLE_RX_RING && rx_rtc_mode) {
+			rte_exit(EXIT_FAILURE, "The lcore map cannot have RX ring cores with -R.\n");
+		}
+		for(uint32_t i = 0; i < conf->nr_queues; i++) {
+			if(served[conf->qids[i]][conf->role]++) {
+				rte_exit(EXIT_FAILURE, "The queue %u has several %s cores in the lcore map.\n", conf->qids[i], role_names[conf->role]);
+			}
+		}
+		nr_lcores++;
+	}
+
+	for(uint32_t q = 0; q < nr_queues; q++) {
+		for(uint8_t role = ROLE_TX; role <= ROLE_RX_RING; role++) {
+			if(!served[q][role] && !(role == ROLE_RX_RING && rx_rtc_mode)) {
+				rte_exit(EXIT_FAILURE, "The queue %u has no %s core in the lcore map.\n", q, role_names[role]);
+			}
+		}
+	}
+
+	return nr_lcores;
+}
+
+// Print the role and the queues of each worker core (and the queues served from another socket than their NIC)
+void print_lcore_map() {
+	printf("\nLcore Map:\n");
+	uint32_t lcore_id;
+	RTE_LCORE_FOREACH_WORKER(lcore_id) {
+		lcore_role_t *conf = &lcore_roles[lcore_id];
+		int socket_id = rte_lcore_to_socket_id(lcore_id);
+		if(conf->role == ROLE_NONE) {
+			continue;
+		}
+		if(conf->role == ROLE_REPLAY) {
+			printf("lcore %u (socket %d): replay\n", lcore_id, socket_id);
+			continue;
+		}
+
+		// the queues in ranges of consecutive ids
+		printf("lcore %u (socket %d): %s of queue%s ", lcore_id, socket_id, role_names[conf->role], conf->nr_queues > 1 ? "s" : "");
+		for(uint32_t i = 0; i < conf->nr_queues; i++) {
+			uint32_t j = i;
+			while(j + 1 < conf->nr_queues && conf->qids[j + 1] == conf->qids[j] + 1) {
+				j++;
+			}
+			printf(j > i ? "%s%u-%u" : "%s%u", i ? "," : "", conf->qids[i], conf->qids[j]);
+			i = j;
+		}
+		printf("\n");
+
+		for(uint32_t i = 0; i < conf->nr_queues; i++) {
+			uint32_t qid = conf->qids[i];
+			if(queue_socket(qid) != SOCKET_ID_ANY && queue_socket(qid) != socket_id) {
+				RTE_LOG(WARNING, UDP_GENERATOR, "The %s core of queue %u (lcore %u) is on socket %d, but port %u is on socket %d\n",
+					role_names[conf->role], qid, lcore_id, socket_id, queue_port(qid)->portid, queue_socket(qid));
+			}
+		}
+	}
+}
+
+// Frame sizes (without the FCS) and weights of the IMIX presets
+static const uint32_t imix_sizes[] = {60, 590, 1514};
+static const double imix_weights[] = {7, 4, 1};
+static const uint32_t imix_tolly_sizes[] = {60, 74, 572, 1514};
+static const double imix_tolly_weights[] = {55, 5, 17, 23};
+
+// Smallest frame that carries the payload values (the hardware TX timestamp is the fifth one)
+uint32_t min_frame_size() {
+	return PKT_HDR_SIZE + (hw_timestamps ? 5 : 4) * sizeof(uint64_t);
+}
+
+// Add the weight of a frame size to the model (the same size is a single class)
+static void add_size_class(size_model_t *model, uint32_t size, double weight) {
+	for(uint32_t i = 0; i < model->nr_classes; i++) {
+		if(model->classes[i].frame_size == size) {
+			model->weights[i] += weight;
+			return;
+		}
+	}
+
+	if(model->nr_classes == MAX_SIZE_CLASSES) {
+		rte_exit(EXIT_FAILURE, "The size model %s has more than %d frame sizes.\n", model->name, MAX_SIZE_CLASSES);
+	}
+	init_size_class(&model->classes[model->nr_classes], size);
+	model->weights[model->nr_classes++] = weight;
+}
+
+// Add the frame sizes of a preset (the ones too small for the payload are raised to the smallest frame, and the model sent is reported)
+static void add_size_preset(size_model_t *model, const uint32_t *sizes, const double *weights, uint32_t n) {
+	uint8_t raised = 0;
+	for(uint32_t i = 0; i < n; i++) {
+		if(sizes[i] < min_frame_size()) {
+			RTE_LOG(WARNING, UDP_GENERATOR, "The %s frames of %u bytes are raised to %u bytes (the smallest frame that carries the payload values).\n", model->name, sizes[i], min_frame_size());
+			raised = 1;
+		}
+		add_size_class(model, RTE_MAX(sizes[i], min_frame_size()), weights[i]);
+	}
+
+	if(raised) {
+		char classes[MAXSTRLEN] = "";
+		for(uint32_t i = 0; i < model->nr_classes; i++) {
+			size_t len = strlen(classes);
+			snprintf(classes + len, sizeof(classes) - len, "%s%.0f x %u B", i ? ", " : "", model->weights[i], model->classes[i].frame_size);
+		}
+		RTE_LOG(WARNING, UDP_GENERATOR, "The %s model is sent as %s.\n", model->name, classes);
+	}
+}
+
+// Load an empirical CDF of the frame sizes (one "size cumulative_probability" line per size, increasing)
+static void load_size_cdf(const char *filename, size_model_t *model) {
+	FILE *fp = fopen(filename, "r");
+	if(fp == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot open the size CDF file %s.\n", filename);
+	}
+
+	char line[MAXSTRLEN];
+	double last = 0;
+	while(fgets(line, sizeof(line), fp)) {
+		uint32_t size;
+		double cumulative;
+		if(line[0] == '#' || sscanf(line, "%u %lf", &size, &cumulative) != 2) {
+			continue;
+		}
+		if(cumulative < last || cumulative > 1) {
+			rte_exit(EXIT_FAILURE, "The size CDF file %s should increase up to 1.\n", filename);
+		}
+		add_size_class(model, size, cumulative - last);
+		last = cumulative;
+	}
+	fclose(fp);
+
+	if(model->nr_classes == 0) {
+		rte_exit(EXIT_FAILURE, "The size CDF file %s is empty.\n", filename);
+	}
+}
+
+// Parse a size model: SIZE, imix, imix-tolly or cdf:FILENAME (-1 if invalid)
+static int parse_size_model(const char *spec, size_model_t *model) {
+	memset(model, 0, sizeof(size_model_t));
+	snprintf(model->name, sizeof(model->name), "%s", spec);
+
+	if(strcmp(spec, "imix") == 0) {
+		add_size_preset(model, imix_sizes, imix_weights, RTE_DIM(imix_sizes));
+	} else if(strcmp(spec, "imix-tolly") == 0) {
+		add_size_preset(model, imix_tolly_sizes, imix_tolly_weights, RTE_DIM(imix_tolly_sizes));
+	} else if(strncmp(spec, "cdf:", strlen("cdf:")) == 0) {
+		load_size_cdf(spec + strlen("cdf:"), model);
+	} else {
+		char *end = NULL;
+		uint32_t size = strtoul(spec, &end, 10);
+		if(spec[0] == '\0' || *end != '\0') {
+			return -1;
+		}
+		add_size_class(model, size, 1);
+	}
+
+	return 0;
+}
+
+// Average frame size of a model (in bytes)
+static double mean_frame_size(const size_model_t *model) {
+	double sum = 0, total = 0;
+	for(uint32_t i = 0; i < model->nr_classes; i++) {
+		sum += model->classes[i].frame_size * model->weights[i];
+		total += model->weights[i];
+	}
+
+	return total > 0 ? sum/total : 0;
+}
+
+// Create the size class sampler of each queue for the phases with several frame sizes
+void create_size_dists() {
+	for(uint32_t p = 0; p < nr_phases; p++) {
+		size_model_t *sizes = &phases[p].sizes;
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			phases[p].size_dists[i] = NULL;
+			if(sizes->nr_classes > 1) {
+				phases[p].size_dists[i] = create_alias_sampler(sizes->weights, sizes->nr_classes, (2 + p) * RTE_MAX_LCORE + i, queue_socket(i));
+			}
+		}
+	}
+}
+
+// Allocate the latency histograms of each RX core (about 30 KB each)
+void create_latency_hists() {
+	for(uint64_t i = 0; i < nr_queues; i++) {
+		latency_hists[i] = hist_create_array("latency", nr_hist_slots(), queue_socket(i));
+		warmup_hists[i] = hist_create_array("latency_warmup", nr_phases, queue_socket(i));
+		if(hw_timestamps) {
+			hw_latency_hists[i] = hist_create_array("latency_hw", nr_hist_slots(), queue_socket(i));
+		}
+
+		// the send-time error of each phase, written by the TX core
+		send_late_hists[i] = hist_create_array("send_late", nr_phases, queue_socket(i));
+		send_early_hists[i] = hist_create_array("send_early", nr_phases, queue_socket(i));
+		never_sent_hists[i] = hist_create_array("never_sent", nr_phases, queue_socket(i));
+
+		// the counters of each backend, written by the TX and by the RX core of the queue
+		if(backend_stats) {
+			backend_hists[i] = hist_create_array("latency_backend", nr_backends, queue_socket(i));
+			backend_tx_pkts[i] = (uint64_t*) rte_zmalloc_socket("backend_tx", nr_backends * sizeof(uint64_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+			backend_rx_pkts[i] = (uint64_t*) rte_zmalloc_socket("backend_rx", nr_backends * sizeof(uint64_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+			if(backend_tx_pkts[i] == NULL || backend_rx_pkts[i] == NULL) {
+				rte_exit(EXIT_FAILURE, "Cannot alloc the backend counters.\n");
+			}
+		}
+	}
+}
+
+// Allocate the sequence numbers sent and received of the flows of each queue (on the socket of its NIC)
+void create_seq_states() {
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		uint64_t nr_queue_flows = (nr_flows - i + nr_queues - 1)/nr_queues;
+		tx_seqs[i] = (uint32_t*) rte_zmalloc_socket("tx_seqs", nr_queue_flows * sizeof(uint32_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+		seq_states[i] = (seq_state_t*) rte_zmalloc_socket("seq_states", nr_queue_flows * sizeof(seq_state_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
+		if(tx_seqs[i] == NULL || seq_states[i] == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot alloc the sequence numbers.\n");
+		}
+	}
+}
+
+// Merge the histograms of a queue kept by every RX core of its port into a histogram per phase
+static histogram_t *merge_demux_queue(histogram_t **hists, uint32_t qid, const char *name) {
+	histogram_t *merged = hist_create_array(name, nr_phases, queue_socket(qid));
+	uint32_t first = qid - qid % nr_queues_per_port;
+	for(uint32_t i = first; i < first + nr_queues_per_port; i++) {
+		for(uint32_t p = 0; p < nr_phases; p++) {
+			hist_merge(&merged[p], &hists[i][(qid % nr_queues_per_port) * nr_phases + p]);
+		}
+	}
+
+	return merged;
+}
+
+// Gather the samples of each queue recorded by every RX core (software demux), the histograms get one slot per phase again
+void merge_demux_hists() {
+	histogram_t *merged[RTE_MAX_LCORE];
+	histogram_t *merged_hw[RTE_MAX_LCORE];
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		merged[i] = merge_demux_queue(latency_hists, i, "latency");
+		merged_hw[i] = hw_timestamps ? merge_demux_queue(hw_latency_hists, i, "latency_hw") : NULL;
+	}
+
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		rte_free(latency_hists[i]);
+		rte_free(hw_latency_hists[i]);
+		latency_hists[i] = merged[i];
+		hw_latency_hists[i] = merged_hw[i];
+	}
+}
+
+// Gather the per-queue structures used by the RX core
+void init_rx_context(rx_context_t *ctx, uint32_t qid) {
+	ctx->qid = qid;
+	ctx->port = queue_port(qid);
+	ctx->stats = &rx_stats[qid];
+	ctx->phase = 0;
+	ctx->hists = latency_hists[qid];
+	ctx->warmup_hists = warmup_hists[qid];
+	ctx->hw_hists = hw_latency_hists[qid];
+	ctx->backend_hists = backend_hists[qid];
+	ctx->backend_rx_pkts = backend_rx_pkts[qid];
+	ctx->incoming = capture_mode ? incoming_array[qid] : NULL;
+	ctx->incoming_idx = capture_mode ? &incoming_idx_array[qid] : NULL;
+	ctx->completion_rings = outstanding ? completion_rings[qid] : NULL;
+}
+
 // Allocate all nodes for incoming packets (+ 20%)
 void allocate_incoming_nodes() {
 	uint64_t rate_per_queue = rate/nr_queues;
@@ -27,90 +484,102 @@ void allocate_incoming_nodes() {
 		rte_exit(EXIT_FAILURE, "Cannot alloc the incoming array.\n");
 	}
 
+	// the nodes of a queue are written by its RX core, so they live on hugepages of the socket of its NIC
 	for(uint64_t i = 0; i < nr_queues; i++) {
-		incoming_array[i] = (node_t*) malloc(nr_elements_per_queue * sizeof(node_t));
+		incoming_array[i] = (node_t*) rte_malloc_socket("incoming", nr_elements_per_queue * sizeof(node_t), RTE_CACHE_LINE_SIZE, queue_socket(i));
 		if(incoming_array[i] == NULL) {
 			rte_exit(EXIT_FAILURE, "Cannot alloc the incoming array.\n");
 		}
 	}
 
-	incoming_idx_array = (uint64_t*) malloc(nr_queues * sizeof(uint64_t));
+	incoming_idx_array = (uint64_t*) rte_zmalloc("incoming_idx", nr_queues * sizeof(uint64_t), RTE_CACHE_LINE_SIZE);
 	if(incoming_idx_array == NULL) {
 		rte_exit(EXIT_FAILURE, "Cannot alloc the incoming_idx array.\n");
 	}
-
-	for(uint64_t i = 0; i < nr_queues; i++) {
-		incoming_idx_array[i] = 0;
-	}
 } 
 
-// Allocate and create an array for all interarrival packets for rate specified.
-void create_interarrival_array() {
-	uint64_t rate_per_queue = rate/nr_queues;
-	double lambda;
-	if(distribution == UNIFORM_VALUE) {
-		lambda = (1.0/rate_per_queue) * 1000000.0;
-	} else if(distribution == EXPONENTIAL_VALUE) {
-		lambda = 1.0/(1000000.0/rate_per_queue);
-	} else {
-		rte_exit(EXIT_FAILURE, "Cannot define the interarrival distribution.\n");
+// Clean up all allocate structures
+void clean_heap() {
+	if(capture_mode) {
+		for(uint64_t i = 0; i < nr_queues; i++) {
+			rte_free(incoming_array[i]);
+		}
+		free(incoming_array);
+		rte_free(incoming_idx_array);
 	}
 
-	uint64_t nr_elements_per_queue = 2 * rate_per_queue * duration;
-
-	interarrival_array = (uint64_t**) malloc(nr_queues * sizeof(uint64_t*));
-	if(interarrival_array == NULL) {
-		rte_exit(EXIT_FAILURE, "Cannot alloc the interarrival_gap array.\n");
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		rte_free(tx_seqs[i]);
+		rte_free(seq_states[i]);
 	}
 
-	for(uint64_t i = 0; i < nr_queues; i++) {
-		interarrival_array[i] = (uint64_t*) malloc(nr_elements_per_queue * sizeof(uint64_t));
-		if(interarrival_array[i] == NULL) {
-			rte_exit(EXIT_FAILURE, "Cannot alloc the interarrival_gap array.\n");
-		}
-		
-		uint64_t *interarrival_gap = interarrival_array[i];
-		if(distribution == UNIFORM_VALUE) {
-			for(uint64_t j = 0; j < nr_elements_per_queue; j++) {
-				interarrival_gap[j] = lambda * TICKS_PER_US;
-			}
-		} else {
-			for(uint64_t j = 0; j < nr_elements_per_queue; j++) {
-				interarrival_gap[j] = sample(lambda) * TICKS_PER_US;
+	for(uint32_t p = 0; p < nr_phases; p++) {
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			if(phases[p].size_dists[i]) {
+				rte_free(phases[p].size_dists[i]->entries);
+				rte_free(phases[p].size_dists[i]);
 			}
 		}
-	} 
+	}
 }
 
-// Allocate and create an array for all flow indentier to send to the server
-void create_flow_indexes_array() {
-	uint32_t nbits = (uint32_t) log2(nr_queues);
-	uint64_t rate_per_queue = rate/nr_queues;
-	uint64_t nr_elements_per_queue = rate_per_queue * duration;
+// Name of an output file of a phase (the phase is in the name only with a schedule)
+static void phase_output_name(char *filename, size_t size, uint32_t phase) {
+	if(nr_phases > 1) {
+		snprintf(filename, size, "%s.p%u", output_file, phase);
+	} else {
+		snprintf(filename, size, "%s", output_file);
+	}
+}
 
-	flow_indexes_array = (uint16_t**) malloc(nr_queues * sizeof(uint16_t*));
-	if(flow_indexes_array == NULL) {
-		rte_exit(EXIT_FAILURE, "Cannot alloc the flow_indexes array.\n");
+// Load the phases of the schedule file ([phase0], [phase1], ...)
+static void load_schedule(const char *filename) {
+	struct rte_cfgfile *file = rte_cfgfile_load(filename, 0);
+	if(file == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot load the schedule file %s\n", filename);
 	}
 
-	for(uint64_t i = 0; i < nr_queues; i++) {
-		flow_indexes_array[i] = (uint16_t*) malloc(nr_elements_per_queue * sizeof(uint16_t));
-		if(flow_indexes_array[i] == NULL) {
-			rte_exit(EXIT_FAILURE, "Cannot alloc the flow_indexes array.\n");
+	nr_phases = rte_cfgfile_num_sections(file, "phase", strlen("phase"));
+	if(nr_phases == 0 || nr_phases > MAX_PHASES) {
+		rte_exit(EXIT_FAILURE, "The schedule file should have between 1 and %d phases.\n", MAX_PHASES);
+	}
+
+	char section[MAXSTRLEN];
+	for(uint32_t i = 0; i < nr_phases; i++) {
+		phase_t *phase = &phases[i];
+		snprintf(section, sizeof(section), "phase%u", i);
+
+		// rate (pps) and duration (s) are mandatory
+		const char *entry_rate = rte_cfgfile_get_entry(file, section, "rate");
+		const char *entry_duration = rte_cfgfile_get_entry(file, section, "duration");
+		if(entry_rate == NULL || entry_duration == NULL) {
+			rte_exit(EXIT_FAILURE, "The section [%s] of the schedule file needs the rate and the duration.\n", section);
+		}
+		phase->rate = strtoull(entry_rate, NULL, 10);
+		phase->duration = strtoull(entry_duration, NULL, 10);
+		if(phase->rate < nr_queues) {
+			rte_exit(EXIT_FAILURE, "The rate of [%s] should be at least one packet per second per queue.\n", section);
 		}
-		uint16_t *flow_indexes = flow_indexes_array[i];
-		for(int j = 0; j < nr_elements_per_queue; j++) {
-			flow_indexes[j] = ((rte_rand() << nbits) | i) % nr_flows;
+
+		// warm-up (s), the same as the duration by default
+		const char *entry = rte_cfgfile_get_entry(file, section, "warmup");
+		phase->warmup = entry ? strtoull(entry, NULL, 10) : phase->duration;
+
+		// interarrival distribution, -d by default
+		entry = rte_cfgfile_get_entry(file, section, "distribution");
+		phase->distribution = entry ? parse_distribution(entry) : distribution;
+		if(phase->distribution < 0) {
+			rte_exit(EXIT_FAILURE, "Invalid distribution in the section [%s] of the schedule file.\n", section);
+		}
+
+		// frame sizes, -s by default
+		entry = rte_cfgfile_get_entry(file, section, "size");
+		if(parse_size_model(entry ? entry : size_spec, &phase->sizes) != 0) {
+			rte_exit(EXIT_FAILURE, "Invalid size in the section [%s] of the schedule file.\n", section);
 		}
 	}
-}
 
-// Clean up all allocate structures
-void clean_heap() {
-	free(incoming_array);
-	free(incoming_idx_array);
-	free(flow_indexes_array);
-	free(interarrival_array);
+	rte_cfgfile_close(file);
 }
 
 // Usage message
@@ -119,11 +588,24 @@ static void usage(const char *prgname) {
 		"  -d DISTRIBUTION: <uniform|exponential>\n"
 		"  -r RATE: rate in pps\n"
 		"  -f FLOWS: number of flows\n"
-		"  -q QUEUES: number of queues\n"
-		"  -s SIZE: frame size in bytes\n"
+		"  -p POPULARITY: <uniform|zipf:S|hotset:FRACTION:PROBABILITY|file:FILENAME> (default: uniform)\n"
+		"  -q QUEUES: number of queues (per port)\n"
+		"  -s SIZE: <SIZE|imix|imix-tolly|cdf:FILENAME> frame size in bytes, or frame sizes sampled per packet\n"
 		"  -t TIME: time in seconds to send packets\n"
+		"  -P: keep every RTT sample instead of a latency histogram per queue\n"
+		"  -w WINDOW: send all packets due within WINDOW ns in a single burst (default: 0)\n"
 		"  -c FILENAME: name of the configuration file\n"
-		"  -o FILENAME: name of the output file\n",
+		"  -o FILENAME: name of the output file\n"
+		"  -B: write a binary output file per queue (<FILENAME>.<queue>), see udp-decode\n"
+		"  -i INTERVAL: print the live stats every INTERVAL ms (default: 0, disabled)\n"
+		"  -R: process the packets in the RX core (run-to-completion, no RX ring)\n"
+		"  -H: also measure the RTT with the NIC hardware timestamps\n"
+		"  -L OUTSTANDING: closed-loop, each flow keeps OUTSTANDING requests in flight (the rate is ignored)\n"
+		"  -S FILENAME: run the phases of the schedule file back to back (instead of -r, -d and -t)\n"
+		"  -D: software demux, rely on RSS only and find the queue of each response from its flow (no rte_flow)\n"
+		"  -T FILENAME[:SPEEDUP]: replay the UDP/IPv4 packets of a pcap or pcapng trace (instead of -r, -d and -s)\n"
+		"  -l POLICY[:THRESHOLD]: <drop|catchup|shift> packets more than THRESHOLD us late (default: drop:5)\n"
+		"  -m MAP: <tx|rx|ring>:LCORE=FIRST[-LAST][,...] cores of each role and the queues they serve (default: one core per role and queue)\n",
 		prgname
 	);
 }
@@ -135,17 +617,12 @@ int app_parse_args(int argc, char **argv) {
 	char *prgname = argv[0];
 
 	argvopt = argv;
-	while ((opt = getopt(argc, argvopt, "d:r:f:s:q:p:t:c:o:")) != EOF) {
+	while ((opt = getopt(argc, argvopt, "d:r:f:s:q:p:t:Pw:c:o:Bi:RHL:S:DT:l:m:")) != EOF) {
 		switch (opt) {
 		// distribution
 		case 'd':
-			if(strcmp(optarg, "uniform") == 0) {
-				// Uniform distribution 
-				distribution = UNIFORM_VALUE;
-			} else if(strcmp(optarg, "exponential") == 0) {
-				// Exponential distribution
-				distribution = EXPONENTIAL_VALUE;
-			} else {
+			distribution = parse_distribution(optarg);
+			if(distribution < 0) {
 				usage(prgname);
 				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
 			}
@@ -161,16 +638,22 @@ int app_parse_args(int argc, char **argv) {
 			nr_flows = process_int_arg(optarg);
 			break;
 
+		// flow popularity
+		case 'p':
+			if(parse_flow_dist(optarg) != 0) {
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
+			}
+			break;
+
 		// frame size (bytes)
 		case 's':
-			frame_size = process_int_arg(optarg);
-			udp_payload_size = (frame_size - sizeof(struct rte_ether_hdr) - sizeof(struct rte_ipv4_hdr) - sizeof(struct rte_udp_hdr));
+			snprintf(size_spec, sizeof(size_spec), "%s", optarg);
 			break;
 
 		// queues
 		case 'q':
 			nr_queues = process_int_arg(optarg);
-			min_lcores = 3 * nr_queues + 1;
 			break;
 
 		// duration (s)
@@ -178,6 +661,16 @@ int app_parse_args(int argc, char **argv) {
 			duration = process_int_arg(optarg);
 			break;
 
+		// per-packet capture
+		case 'P':
+			capture_mode = 1;
+			break;
+
+		// burst window (ns)
+		case 'w':
+			burst_window_ns = process_int_arg(optarg);
+			break;
+
 		// config file name
 		case 'c':
 			process_config_file(optarg);
@@ -188,6 +681,62 @@ int app_parse_args(int argc, char **argv) {
 			strcpy(output_file, optarg);
 			break;
 
+		// binary output
+		case 'B':
+			binary_output = 1;
+			break;
+
+		// live stats interval (ms)
+		case 'i':
+			report_interval_ms = process_int_arg(optarg);
+			break;
+
+		// run-to-completion RX
+		case 'R':
+			rx_rtc_mode = 1;
+			break;
+
+		// hardware timestamps
+		case 'H':
+			hw_timestamps = 1;
+			break;
+
+		// closed-loop
+		case 'L':
+			outstanding = process_int_arg(optarg);
+			break;
+
+		// rate schedule
+		case 'S':
+			strcpy(schedule_file, optarg);
+			break;
+
+		// software demux
+		case 'D':
+			soft_demux = 1;
+			break;
+
+		// lateness policy
+		case 'l':
+			if(parse_late_policy(optarg) != 0) {
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
+			}
+			break;
+
+		// lcore map
+		case 'm':
+			snprintf(lcore_map_spec, sizeof(lcore_map_spec), "%s", optarg);
+			break;
+
+		// trace replay
+		case 'T':
+			if(parse_replay(optarg) != 0) {
+				usage(prgname);
+				rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
+			}
+			break;
+
 		default:
 			usage(prgname);
 			rte_exit(EXIT_FAILURE, "Invalid arguments.\n");
@@ -198,20 +747,278 @@ int app_parse_args(int argc, char **argv) {
 		argv[optind-1] = prgname;
 	}
 
+	// a single port (port 0) if the configuration file has no [portN] section
+	if(nr_ports == 0) {
+		ports[0].portid = 0;
+		ports[0].src_eth_addr = src_eth_addr;
+		ports[0].dst_eth_addr = dst_eth_addr;
+		ports[0].src_ipv4_addr = src_ipv4_addr;
+		ports[0].nr_src_ipv4_addrs = nr_src_ipv4_addrs;
+		ports[0].dst_ipv4_addr = dst_ipv4_addr;
+		ports[0].src_udp_port = src_udp_port;
+		ports[0].nr_src_udp_ports = nr_src_udp_ports;
+		ports[0].dst_udp_port = dst_udp_port;
+		nr_ports = 1;
+	}
+
+	// the ports without any backend send to their own destination
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		uint32_t b = 0;
+		while(b < nr_backends && backends[b].port != p) {
+			b++;
+		}
+		if(b == nr_backends) {
+			if(nr_backends == MAX_BACKENDS) {
+				rte_exit(EXIT_FAILURE, "Too many backends (up to %u).\n", MAX_BACKENDS);
+			}
+			backends[nr_backends++] = (backend_t) {
+				.port = p,
+				.weight = 1,
+				.dst_eth_addr = ports[p].dst_eth_addr,
+				.dst_ipv4_addr = ports[p].dst_ipv4_addr,
+				.dst_udp_port = ports[p].dst_udp_port,
+			};
+		}
+	}
+
+	// the trace has its own destinations
+	if(replay_file[0] && backend_stats) {
+		rte_exit(EXIT_FAILURE, "The backends cannot be used with -T.\n");
+	}
+
+	// -q is per port, the queues of all ports are numbered one after the other
+	nr_queues_per_port = nr_queues;
+	nr_queues = nr_queues_per_port * nr_ports;
+
 	if(nr_flows < nr_queues) {
 		rte_exit(EXIT_FAILURE, "The number of flows should be bigger than the number of queues.\n");
 	}
 
+	// a single phase with the command line parameters if there is no schedule (the first half of the run is for warming up)
+	if(schedule_file[0]) {
+		if(capture_mode || outstanding || replay_file[0]) {
+			rte_exit(EXIT_FAILURE, "The schedule file cannot be used with -P, -L or -T.\n");
+		}
+		load_schedule(schedule_file);
+	} else if(replay_file[0]) {
+		// the trace gives the schedule, the 5-tuples and the sizes (up to a standard frame)
+		if(outstanding) {
+			rte_exit(EXIT_FAILURE, "The trace replay cannot be used with -L.\n");
+		}
+		// the rte_flow rules match only the generated 5-tuples, the responses to the trace are accounted from the payload
+		if(!soft_demux) {
+			rte_exit(EXIT_FAILURE, "The trace replay needs -D.\n");
+		}
+		phases[0].rate = rate;
+		phases[0].duration = duration;
+		phases[0].warmup = duration;
+		phases[0].distribution = distribution;
+		memset(&phases[0].sizes, 0, sizeof(size_model_t));
+		snprintf(phases[0].sizes.name, sizeof(phases[0].sizes.name), "trace");
+		add_size_class(&phases[0].sizes, REPLAY_MAX_FRAME_SIZE, 1);
+		nr_phases = 1;
+	} else {
+		phases[0].rate = rate;
+		phases[0].duration = duration;
+		phases[0].warmup = duration;
+		phases[0].distribution = distribution;
+		if(parse_size_model(size_spec, &phases[0].sizes) != 0) {
+			usage(prgname);
+			rte_exit(EXIT_FAILURE, "Invalid frame size.\n");
+		}
+		nr_phases = 1;
+	}
+
+	max_frame_size = 0;
+	for(uint32_t i = 0; i < nr_phases; i++) {
+		for(uint32_t c = 0; c < phases[i].sizes.nr_classes; c++) {
+			uint32_t size = phases[i].sizes.classes[c].frame_size;
+
+			// the timestamps, the flow and the thread are the first values of the payload
+			if(size < PKT_HDR_SIZE + 4 * sizeof(uint64_t) || size > RTE_MBUF_DEFAULT_DATAROOM) {
+				rte_exit(EXIT_FAILURE, "The frame size should be between %lu and %u bytes.\n", PKT_HDR_SIZE + 4 * sizeof(uint64_t), RTE_MBUF_DEFAULT_DATAROOM);
+			}
+
+			// the hardware TX timestamp is the fifth value of the payload
+			if(hw_timestamps && size < PKT_HDR_SIZE + 5 * sizeof(uint64_t)) {
+				rte_exit(EXIT_FAILURE, "The hardware timestamps need a frame size of at least %lu bytes.\n", PKT_HDR_SIZE + 5 * sizeof(uint64_t));
+			}
+
+			if(size > max_frame_size) {
+				max_frame_size = size;
+			}
+		}
+	}
+
+	// RX ring, RX and TX cores for each queue (no RX ring core in run-to-completion), or the cores of the map
+	if(nr_queues > RTE_MAX_LCORE) {
+		rte_exit(EXIT_FAILURE, "Too many queues (up to %u).\n", RTE_MAX_LCORE);
+	}
+	if(lcore_map_spec[0]) {
+		if(parse_lcore_map(lcore_map_spec) != 0) {
+			usage(prgname);
+			rte_exit(EXIT_FAILURE, "Invalid lcore map.\n");
+		}
+		min_lcores = check_lcore_map() + 1;
+	} else {
+		min_lcores = (rx_rtc_mode ? 2 : 3) * nr_queues + 1;
+	}
+
+	// the trace reader has its own core
+	if(replay_file[0]) {
+		min_lcores++;
+	}
+
 	ret = optind-1;
 	optind = 1;
 
 	return ret;
 }
 
-// Wait for the duration parameter
+// Peak number of mbufs in use of the pools of each queue
+static uint32_t rx_pool_peak[RTE_MAX_LCORE];
+static uint32_t tx_pool_peak[RTE_MAX_LCORE];
+
+// Sample the number of mbufs in use of the pools of each queue
+static void sample_pool_usage() {
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		rx_pool_peak[i] = RTE_MAX(rx_pool_peak[i], rte_mempool_in_use_count(pktmbuf_pools[i]));
+		tx_pool_peak[i] = RTE_MAX(tx_pool_peak[i], rte_mempool_in_use_count(pktmbuf_pools_tx[i]));
+	}
+}
+
+// Print the size and the peak fill level of the pools of each queue
+void print_pool_stats() {
+	printf("\nMempool Stats:\n");
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		struct rte_mempool *rx_pool = pktmbuf_pools[i];
+		struct rte_mempool *tx_pool = pktmbuf_pools_tx[i];
+		printf("queue %u: RX pool %u mbufs of %u bytes, peak %u in use (%.1f%%), TX pool %u mbufs of %u bytes, peak %u in use (%.1f%%)\n",
+			i,
+			rx_pool->size, rte_pktmbuf_data_room_size(rx_pool), rx_pool_peak[i], (100.0 * rx_pool_peak[i])/rx_pool->size,
+			tx_pool->size, rte_pktmbuf_data_room_size(tx_pool), tx_pool_peak[i], (100.0 * tx_pool_peak[i])/tx_pool->size
+		);
+	}
+}
+
+// Counters at the last live report
+static uint64_t last_tx[RTE_MAX_LCORE];
+static uint64_t last_rx[RTE_MAX_LCORE];
+static uint64_t last_tx_bytes[RTE_MAX_LCORE];
+static uint64_t last_rx_bytes[RTE_MAX_LCORE];
+static uint64_t last_never_sent[RTE_MAX_LCORE];
+static histogram_t *last_hists[RTE_MAX_LCORE];
+static histogram_t *last_warmup_hists[RTE_MAX_LCORE];
+static histogram_t *interval_hist;
+static uint64_t last_drops;
+
+// Print the throughput and latency of the last interval (read from the per-queue counters)
+static void print_live_stats(uint64_t elapsed, uint64_t interval) {
+	if(interval_hist == NULL) {
+		interval_hist = hist_create("latency_interval");
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			last_hists[i] = hist_create_array("latency_last", nr_hist_slots(), SOCKET_ID_ANY);
+			last_warmup_hists[i] = hist_create_array("latency_last", nr_phases, SOCKET_ID_ANY);
+		}
+	}
+
+	uint64_t nr_tx = 0, nr_rx = 0, nr_tx_bytes = 0, nr_rx_bytes = 0, nr_never_sent = 0;
+	hist_reset(interval_hist);
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		uint64_t tx = *((volatile uint64_t*) &tx_stats[i].nr_pkts);
+		uint64_t rx = *((volatile uint64_t*) &rx_stats[i].nr_pkts);
+		uint64_t tx_bytes = *((volatile uint64_t*) &tx_stats[i].nr_bytes);
+		uint64_t rx_bytes = *((volatile uint64_t*) &rx_stats[i].nr_bytes);
+		uint64_t never_sent = *((volatile uint64_t*) &tx_stats[i].nr_never_sent);
+
+		nr_tx += tx - last_tx[i];
+		nr_rx += rx - last_rx[i];
+		nr_tx_bytes += tx_bytes - last_tx_bytes[i];
+		nr_rx_bytes += rx_bytes - last_rx_bytes[i];
+		nr_never_sent += never_sent - last_never_sent[i];
+		last_tx[i] = tx;
+		last_rx[i] = rx;
+		last_tx_bytes[i] = tx_bytes;
+		last_rx_bytes[i] = rx_bytes;
+		last_never_sent[i] = never_sent;
+
+		for(uint32_t p = 0; p < nr_phases; p++) {
+			hist_delta(interval_hist, &last_warmup_hists[i][p], &warmup_hists[i][p]);
+		}
+		for(uint32_t p = 0; p < nr_hist_slots(); p++) {
+			hist_delta(interval_hist, &last_hists[i][p], &latency_hists[i][p]);
+		}
+	}
+
+	// packets dropped by the NICs
+	uint64_t drops = 0;
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		struct rte_eth_stats eth_stats;
+		if(rte_eth_stats_get(ports[p].portid, &eth_stats) == 0) {
+			drops += eth_stats.imissed + eth_stats.rx_nombuf;
+		}
+	}
+
+	double seconds = ((double) interval)/(TICKS_PER_US * 1000000);
+	double ticks_per_ns = (double)TICKS_PER_US/1000;
+	printf("[%8.3f s] ", ((double) elapsed)/(TICKS_PER_US * 1000000));
+	if(nr_phases > 1) {
+		uint32_t phase = 0;
+		while(phase + 1 < nr_phases && phases[0].start_tsc + elapsed >= phases[phase + 1].start_tsc) {
+			phase++;
+		}
+		printf("phase %u\t", phase);
+	}
+	printf("tx %.0f pps (%.3f Gbps)\trx %.0f pps (%.3f Gbps)\tdrops %lu\tnever_sent %lu\tp50 %.0f ns\tp99 %.0f ns\tp99.9 %.0f ns\n",
+		nr_tx/seconds, (nr_tx_bytes * 8)/(seconds * 1000000000),
+		nr_rx/seconds, (nr_rx_bytes * 8)/(seconds * 1000000000),
+		drops - last_drops, nr_never_sent,
+		hist_percentile(interval_hist, 50)/ticks_per_ns,
+		hist_percentile(interval_hist, 99)/ticks_per_ns,
+		hist_percentile(interval_hist, 99.9)/ticks_per_ns
+	);
+	fflush(stdout);
+
+	last_drops = drops;
+}
+
+// Set the absolute limits of every phase from the start of the run
+void start_phases(uint64_t t0) {
+	for(uint32_t i = 0; i < nr_phases; i++) {
+		phases[i].start_tsc = t0;
+		phases[i].warmup_tsc = phases[i].start_tsc + phases[i].warmup * 1000000 * TICKS_PER_US;
+		phases[i].end_tsc = phases[i].warmup_tsc + phases[i].duration * 1000000 * TICKS_PER_US;
+		t0 = phases[i].end_tsc;
+	}
+}
+
+// Wait for the end of the last phase (reporting the live stats every interval)
 void wait_timeout() {
-	uint64_t t0 = rte_rdtsc();
-	while((rte_rdtsc() - t0) < (2 * duration * 1000000 * TICKS_PER_US)) { }
+	uint64_t now;
+	uint64_t t0 = phases[0].start_tsc;
+	uint64_t interval = report_interval_ms * 1000 * TICKS_PER_US;
+	uint64_t next_report = t0 + interval;
+	uint64_t next_sample = t0;
+	uint64_t next_calibration = t0 + HW_CLOCK_CALIBRATE_MS * 1000 * TICKS_PER_US;
+	while((now = rte_rdtsc()) < phases[nr_phases - 1].end_tsc) {
+		if(now >= next_sample) {
+			sample_pool_usage();
+			next_sample += POOL_SAMPLE_US * TICKS_PER_US;
+		}
+		// follow the drift of the NIC clocks
+		if(hw_timestamps && now >= next_calibration) {
+			for(uint32_t p = 0; p < nr_ports; p++) {
+				if(ports[p].hw_timestamps) {
+					recalibrate_hw_clock(&ports[p]);
+				}
+			}
+			next_calibration += HW_CLOCK_CALIBRATE_MS * 1000 * TICKS_PER_US;
+		}
+		if(interval && now >= next_report) {
+			print_live_stats(now - t0, interval);
+			next_report += interval;
+		}
+	}
 
 	// wait for remaining
 	t0 = rte_rdtsc_precise();
@@ -231,14 +1038,18 @@ int cmp_func(const void * a, const void * b) {
 	return (da - db) > ( (fabs(da) < fabs(db) ? fabs(db) : fabs(da)) * EPSILON);
 }
 
-// Print stats into output file
-void print_stats_output() {
-	// open the file
-	FILE *fp = fopen(output_file, "w");
-	if(fp == NULL) {
-		rte_exit(EXIT_FAILURE, "Cannot open the output file.\n");
+// Hardware RTT of a packet received by the port in (ticks), 0 if not available
+static uint64_t node_hw_rtt(port_t *port, node_t *node) {
+	if(node->hw_timestamp_tx == 0 || node->hw_timestamp_rx <= node->hw_timestamp_tx) {
+		return 0;
 	}
 
+	return nic_to_ticks(port, node->hw_timestamp_rx - node->hw_timestamp_tx);
+}
+
+// Print the RTT samples of every packet into the output file
+static void print_capture_output(FILE *fp) {
+	double ticks_per_ns = (double)TICKS_PER_US/1000;
 	for(uint32_t i = 0; i < nr_queues; i++) {
 		// get the pointers
 		node_t *incoming = incoming_array[i];
@@ -252,18 +1063,585 @@ void print_stats_output() {
 		for(; j < incoming_idx; j++) {
 			cur = &incoming[j];
 
-			fprintf(fp, "%lu\t%lu\n",
-				cur->flow_id,
-				((uint64_t)((cur->timestamp_rx - cur->timestamp_tx)/((double)TICKS_PER_US/1000)))
+			if(hw_timestamps) {
+				fprintf(fp, "%lu\t%lu\t%lu\n",
+					cur->flow_id,
+					((uint64_t)((cur->timestamp_rx - cur->timestamp_tx)/ticks_per_ns)),
+					((uint64_t)(node_hw_rtt(queue_port(i), cur)/ticks_per_ns))
+				);
+			} else {
+				fprintf(fp, "%lu\t%lu\n",
+					cur->flow_id,
+					((uint64_t)((cur->timestamp_rx - cur->timestamp_tx)/ticks_per_ns))
+				);
+			}
+		}
+	}
+}
+
+// Print the merged latency histogram into the output file
+static void print_histogram_output(FILE *fp, histogram_t *total, histogram_t *hw_total) {
+	// print each non-empty bucket as the lowest RTT latency in (ns) and its count
+	double ticks_per_ns = (double)TICKS_PER_US/1000;
+	for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+		if(hw_total) {
+			if(total->buckets[i] || hw_total->buckets[i]) {
+				fprintf(fp, "%lu\t%lu\t%lu\n", (uint64_t)(hist_value(i)/ticks_per_ns), total->buckets[i], hw_total->buckets[i]);
+			}
+		} else if(total->buckets[i]) {
+			fprintf(fp, "%lu\t%lu\n", (uint64_t)(hist_value(i)/ticks_per_ns), total->buckets[i]);
+		}
+	}
+}
+
+// Print the summary of the merged latency histogram
+static void print_latency_summary(const char *title, histogram_t *total) {
+	double ticks_per_ns = (double)TICKS_PER_US/1000;
+
+	printf("\n%s (ns):\n", title);
+	if(total->count) {
+		printf("samples: %lu\nmin: %.0f\navg: %.0f\np50: %.0f\np99: %.0f\np99.9: %.0f\nmax: %.0f\n",
+			total->count,
+			total->min/ticks_per_ns,
+			(total->sum/((double) total->count))/ticks_per_ns,
+			hist_percentile(total, 50)/ticks_per_ns,
+			hist_percentile(total, 99)/ticks_per_ns,
+			hist_percentile(total, 99.9)/ticks_per_ns,
+			total->max/ticks_per_ns
+		);
+	} else {
+		printf("samples: 0\n");
+	}
+}
+
+// Print the error added by the generator (software RTT minus hardware RTT)
+static void print_hw_error_summary() {
+	int64_t error_sum = 0;
+	uint64_t nr_samples = 0;
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		error_sum += rx_stats[i].hw_error_sum;
+		nr_samples += rx_stats[i].hw_nr_samples;
+	}
+
+	printf("\nGenerator-induced RTT error (software - hardware):\n");
+	if(nr_samples) {
+		printf("samples: %lu\navg: %.1f ns\n", nr_samples, (error_sum/((double) nr_samples))/((double)TICKS_PER_US/1000));
+	} else {
+		printf("samples: 0 (no packet carried both hardware timestamps)\n");
+	}
+}
+
+// Print the send time minus the scheduled time of the packets of a phase into <output>-send (<output>.p<phase>-send with a schedule)
+// as the error in (ns) and its count, early packets first with a negative error
+static void print_send_error_output(uint32_t phase, histogram_t *late, histogram_t *early) {
+	char prefix[MAXSTRLEN + 16];
+	char filename[MAXSTRLEN + 32];
+	phase_output_name(prefix, sizeof(prefix), phase);
+	snprintf(filename, sizeof(filename), "%s-send", prefix);
+
+	FILE *fp = fopen(filename, "w");
+	if(fp == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot open the output file %s.\n", filename);
+	}
+
+	double ticks_per_ns = (double)TICKS_PER_US/1000;
+	for(int32_t i = HIST_NR_BUCKETS - 1; i > 0; i--) {
+		if(early->buckets[i]) {
+			fprintf(fp, "-%lu\t%lu\n", (uint64_t)(hist_value(i)/ticks_per_ns), early->buckets[i]);
+		}
+	}
+	for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+		if(late->buckets[i]) {
+			fprintf(fp, "%lu\t%lu\n", (uint64_t)(hist_value(i)/ticks_per_ns), late->buckets[i]);
+		}
+	}
+
+	fclose(fp);
+}
+
+// Print the summary of the send-time error of a phase (did the generator keep up with the schedule?)
+static void print_send_error_summary(uint32_t phase) {
+	histogram_t *late = hist_create("send_late_total");
+	histogram_t *early = hist_create("send_early_total");
+	histogram_t *never_sent = hist_create("never_sent_total");
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		hist_merge(late, &send_late_hists[i][phase]);
+		hist_merge(early, &send_early_hists[i][phase]);
+		hist_merge(never_sent, &never_sent_hists[i][phase]);
+	}
+
+	print_send_error_output(phase, late, early);
+
+	// late packets (sent after their scheduled time)
+	print_latency_summary("Send-time Lateness", late);
+
+	// early packets (sent ahead in a burst window) and packets never sent, by how late they were
+	uint64_t us = TICKS_PER_US;
+	printf("early: %lu (avg %.0f ns)\n", early->count, early->count ? (early->sum/((double) early->count))/((double)TICKS_PER_US/1000) : 0);
+	printf("never sent: %lu (< 10 us late: %lu, 10-100 us: %lu, 100 us-1 ms: %lu, > 1 ms: %lu)\n",
+		never_sent->count,
+		hist_count_range(never_sent, 0, 10 * us),
+		hist_count_range(never_sent, 10 * us, 100 * us),
+		hist_count_range(never_sent, 100 * us, 1000 * us),
+		hist_count_range(never_sent, 1000 * us, UINT64_MAX)
+	);
+
+	rte_free(late);
+	rte_free(early);
+	rte_free(never_sent);
+}
+
+// Write the records of an array by chunks
+static void write_records(FILE *fp, const void *records, size_t size, uint32_t n) {
+	if(n && fwrite(records, size, n, fp) != n) {
+		rte_exit(EXIT_FAILURE, "Cannot write the binary output.\n");
+	}
+}
+
+// Write the binary output of one queue and one phase into <output>.<queue> (<output>.p<phase>.<queue> with a schedule)
+static void write_binary_output_phase(uint32_t qid, uint32_t phase) {
+	char prefix[MAXSTRLEN + 16];
+	char filename[MAXSTRLEN + 32];
+	phase_output_name(prefix, sizeof(prefix), phase);
+	snprintf(filename, sizeof(filename), "%s.%u", prefix, qid);
+
+	FILE *fp = fopen(filename, "wb");
+	if(fp == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot open the output file %s.\n", filename);
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	output_header_t header = {
+		.magic = OUTPUT_MAGIC,
+		.version = OUTPUT_VERSION,
+		.type = capture_mode ? (hw_timestamps ? OUTPUT_TYPE_CAPTURE_HW : OUTPUT_TYPE_CAPTURE) : (hw_timestamps ? OUTPUT_TYPE_HISTOGRAM_HW : OUTPUT_TYPE_HISTOGRAM),
+		.ticks_per_us = TICKS_PER_US,
+		.queue = qid,
+		.nr_queues = nr_queues,
+		.nr_flows = nr_flows,
+		.phase = phase,
+		.nr_phases = nr_phases,
+		.rate = phases[phase].rate,
+		.frame_size = (uint32_t) mean_frame_size(&phases[phase].sizes),
+		.warmup_samples = 0,
+		.warmup_ticks = phases[phase].warmup * 1000000 * TICKS_PER_US,
+		.nr_records = 0,
+	};
+
+	if(capture_mode) {
+		node_t *incoming = incoming_array[qid];
+		uint64_t incoming_idx = incoming_idx_array[qid];
+
+		// drop the first 50% packets for warming up
+		header.warmup_samples = 0.5 * incoming_idx;
+		header.nr_records = incoming_idx - header.warmup_samples;
+		fwrite(&header, sizeof(header), 1, fp);
+
+		// write the RTT latency in (ticks) by chunks
+		uint32_t n = 0;
+		if(hw_timestamps) {
+			output_capture_hw_t records[BURST_RECORDS];
+			for(uint64_t j = header.warmup_samples; j < incoming_idx; j++) {
+				records[n].flow_id = incoming[j].flow_id;
+				records[n].rtt = incoming[j].timestamp_rx - incoming[j].timestamp_tx;
+				records[n].hw_rtt = node_hw_rtt(queue_port(qid), &incoming[j]);
+				if(++n == BURST_RECORDS) {
+					write_records(fp, records, sizeof(output_capture_hw_t), n);
+					n = 0;
+				}
+			}
+			write_records(fp, records, sizeof(output_capture_hw_t), n);
+		} else {
+			output_capture_t records[BURST_RECORDS];
+			for(uint64_t j = header.warmup_samples; j < incoming_idx; j++) {
+				records[n].flow_id = incoming[j].flow_id;
+				records[n].rtt = incoming[j].timestamp_rx - incoming[j].timestamp_tx;
+				if(++n == BURST_RECORDS) {
+					write_records(fp, records, sizeof(output_capture_t), n);
+					n = 0;
+				}
+			}
+			write_records(fp, records, sizeof(output_capture_t), n);
+		}
+	} else {
+		histogram_t *hist = &latency_hists[qid][phase];
+		histogram_t *hw_hist = hw_timestamps ? &hw_latency_hists[qid][phase] : NULL;
+		for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+			header.nr_records += (hist->buckets[i] != 0 || (hw_hist && hw_hist->buckets[i] != 0));
+		}
+		fwrite(&header, sizeof(header), 1, fp);
+
+		// write each non-empty bucket
+		for(uint32_t i = 0; i < HIST_NR_BUCKETS; i++) {
+			if(hw_hist) {
+				if(hist->buckets[i] || hw_hist->buckets[i]) {
+					output_bucket_hw_t bucket = { .value = hist_value(i), .count = hist->buckets[i], .hw_count = hw_hist->buckets[i] };
+					write_records(fp, &bucket, sizeof(bucket), 1);
+				}
+			} else if(hist->buckets[i]) {
+				output_bucket_t bucket = { .value = hist_value(i), .count = hist->buckets[i] };
+				write_records(fp, &bucket, sizeof(bucket), 1);
+			}
+		}
+	}
+
+	if(fclose(fp) != 0) {
+		rte_exit(EXIT_FAILURE, "Cannot write the output file %s.\n", filename);
+	}
+}
+
+// Write the binary output of all phases of one queue
+void write_binary_output(uint32_t qid) {
+	for(uint32_t p = 0; p < nr_phases; p++) {
+		write_binary_output_phase(qid, p);
+	}
+}
+
+// Print stats of a phase into its output file (the binary output is written by the per-queue writers)
+static void print_stats_output_phase(uint32_t phase) {
+	histogram_t *total = NULL;
+	histogram_t *hw_total = NULL;
+	if(!capture_mode) {
+		total = hist_create("latency_total");
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			hist_merge(total, &latency_hists[i][phase]);
+		}
+	}
+	if(hw_timestamps) {
+		hw_total = hist_create("latency_hw_total");
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			hist_merge(hw_total, &hw_latency_hists[i][phase]);
+		}
+	}
+
+	if(!binary_output) {
+		// open the file
+		char filename[MAXSTRLEN + 16];
+		phase_output_name(filename, sizeof(filename), phase);
+		FILE *fp = fopen(filename, "w");
+		if(fp == NULL) {
+			rte_exit(EXIT_FAILURE, "Cannot open the output file.\n");
+		}
+
+		if(capture_mode) {
+			print_capture_output(fp);
+		} else {
+			print_histogram_output(fp, total, hw_total);
+		}
+
+		// close the file
+		fclose(fp);
+	}
+
+	if(nr_phases > 1) {
+		phase_t *p = &phases[phase];
+		printf("\nPhase %u: %lu pps, %s, %s (%.1f bytes on average), %lu s (+ %lu s of warm-up)\n", phase, p->rate,
+			p->distribution == UNIFORM_VALUE ? "uniform" : "exponential",
+			p->sizes.name, mean_frame_size(&p->sizes), p->duration, p->warmup);
+	}
+	if(total) {
+		print_latency_summary("RTT Latency", total);
+		rte_free(total);
+	}
+	if(hw_total) {
+		print_latency_summary("Hardware RTT Latency", hw_total);
+		rte_free(hw_total);
+	}
+
+	// accuracy of the send times (the closed-loop has no schedule)
+	if(!outstanding) {
+		print_send_error_summary(phase);
+	}
+
+	// latency of each port (merged from its queues)
+	if(nr_ports > 1 && !capture_mode) {
+		char title[MAXSTRLEN];
+		histogram_t *port_total = hist_create("latency_port");
+		for(uint32_t p = 0; p < nr_ports; p++) {
+			hist_reset(port_total);
+			for(uint32_t i = p * nr_queues_per_port; i < (p + 1) * nr_queues_per_port; i++) {
+				hist_merge(port_total, &latency_hists[i][phase]);
+			}
+			snprintf(title, sizeof(title), "RTT Latency (port %u)", ports[p].portid);
+			print_latency_summary(title, port_total);
+		}
+		rte_free(port_total);
+	}
+}
+
+// Print stats of every phase
+void print_stats_output() {
+	for(uint32_t p = 0; p < nr_phases; p++) {
+		print_stats_output_phase(p);
+	}
+
+	if(hw_timestamps) {
+		print_hw_error_summary();
+		print_hw_clock_drift();
+	}
+}
+
+// Duration of the whole run, warm-ups included (in seconds)
+static double run_seconds() {
+	return ((double) (phases[nr_phases - 1].end_tsc - phases[0].start_tsc))/(TICKS_PER_US * 1000000);
+}
+
+// Print the packet and bit rates of all queues over the whole run
+static void print_throughput(const char *direction, uint64_t nr_pkts, uint64_t nr_bytes) {
+	double seconds = run_seconds();
+	printf("all queues: %lu packets %s, %.0f pps, %.3f Gbps (%.1f bytes on average)\n",
+		nr_pkts, direction, nr_pkts/seconds, (nr_bytes * 8)/(seconds * 1000000000),
+		nr_pkts ? ((double) nr_bytes)/nr_pkts : 0.0
+	);
+}
+
+// Print the RX stats
+void print_rx_stats() {
+	uint64_t nr_pkts = 0, nr_bytes = 0;
+	printf("\nRX Stats:\n");
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		rx_stats_t *stats = &rx_stats[i];
+		nr_pkts += stats->nr_pkts;
+		nr_bytes += stats->nr_bytes;
+		printf("queue %u: %lu packets, %lu empty", i, stats->nr_pkts, stats->nr_empty);
+		if(stats->nr_unknown || stats->nr_misrouted) {
+			printf(", %lu of unknown flows, %lu of flows of other queues (not tracked)", stats->nr_unknown, stats->nr_misrouted);
+		}
+		if(!rx_rtc_mode && stats->nr_pkts) {
+			printf(", RX ring hop avg %.1f ns, max %.1f ns",
+				(stats->ring_delay_sum/((double) stats->nr_pkts))/((double)TICKS_PER_US/1000),
+				stats->ring_delay_max/((double)TICKS_PER_US/1000)
 			);
 		}
+		printf("\n");
 	}
+	print_throughput("received", nr_pkts, nr_bytes);
+}
+
+// Print the losses, duplicates and reordering of each queue, and of each flow into <output>-flows
+// (flow_id sent received lost duplicated reordered old)
+void print_seq_stats() {
+	char filename[MAXSTRLEN + 16];
+	snprintf(filename, sizeof(filename), "%s-flows", output_file);
+	FILE *fp = fopen(filename, "w");
+	if(fp == NULL) {
+		rte_exit(EXIT_FAILURE, "Cannot open the output file %s.\n", filename);
+	}
+	setvbuf(fp, NULL, _IOFBF, 1 << 20);
+
+	uint64_t total[6] = {0};
+	printf("\nSequence Stats:\n");
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		uint64_t sent = 0, received = 0, lost = 0, duplicated = 0, reordered = 0, old = 0;
+		for(uint64_t f = i; f < nr_flows; f += nr_queues) {
+			uint32_t flow_sent = tx_seqs[i][f / nr_queues];
+			seq_state_t *state = &seq_states[i][f / nr_queues];
+
+			// the packets sent after the last one received are lost too
+			uint32_t flow_lost = state->nr_lost + (flow_sent > state->next ? flow_sent - state->next : 0);
+			fprintf(fp, "%lu\t%u\t%u\t%u\t%u\t%u\t%u\n", f, flow_sent, state->nr_received, flow_lost,
+				state->nr_duplicated, state->nr_reordered, state->nr_old);
+
+			sent += flow_sent;
+			received += state->nr_received;
+			lost += flow_lost;
+			duplicated += state->nr_duplicated;
+			reordered += state->nr_reordered;
+			old += state->nr_old;
+		}
+
+		printf("queue %u: %lu packets sent, %lu received, %lu lost (%.3f%%), %lu duplicated, %lu reordered, %lu older than the last %u\n",
+			i, sent, received, lost, sent ? (100.0 * lost)/sent : 0, duplicated, reordered, old, SEQ_WINDOW);
+		total[0] += sent;
+		total[1] += received;
+		total[2] += lost;
+		total[3] += duplicated;
+		total[4] += reordered;
+		total[5] += old;
+	}
+	printf("all queues: %lu packets sent, %lu received, %lu lost (%.3f%%), %lu duplicated, %lu reordered, %lu older than the last %u\n",
+		total[0], total[1], total[2], total[0] ? (100.0 * total[2])/total[0] : 0, total[3], total[4], total[5], SEQ_WINDOW);
 
-	// close the file
 	fclose(fp);
 }
 
+// Print the TX pacing stats
+void print_tx_stats() {
+	uint64_t nr_pkts = 0, nr_bytes = 0;
+	printf("\nTX Pacing Stats:\n");
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		tx_stats_t *stats = &tx_stats[i];
+		nr_pkts += stats->nr_pkts;
+		nr_bytes += stats->nr_bytes;
+		if(stats->nr_bursts == 0) {
+			continue;
+		}
+
+		printf("queue %u: %lu packets in %lu bursts (%.2f pkts/burst), %lu never sent, %lu timed out, pacing error avg %.1f ns, max %.1f ns\n",
+			i, stats->nr_pkts, stats->nr_bursts,
+			((double) stats->nr_pkts)/stats->nr_bursts,
+			stats->nr_never_sent,
+			stats->nr_timeouts,
+			(stats->pacing_error_sum/((double) stats->nr_pkts))/((double)TICKS_PER_US/1000),
+			stats->pacing_error_max/((double)TICKS_PER_US/1000)
+		);
+	}
+	print_throughput("sent", nr_pkts, nr_bytes);
+
+	// load offered by each queue versus the load of the schedule (the closed-loop has none)
+	if(outstanding) {
+		return;
+	}
+	double seconds = run_seconds();
+	uint64_t nr_scheduled = 0;
+	for(uint32_t p = 0; p < nr_phases; p++) {
+		nr_scheduled += phases[p].rate * (phases[p].warmup + phases[p].duration);
+	}
+	printf("\nOffered Load (%s, %lu us late threshold):\n",
+		late_policy == LATE_DROP ? "drop" : (late_policy == LATE_CATCHUP ? "catchup" : "shift"), late_threshold_us);
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		tx_stats_t *stats = &tx_stats[i];
+
+		// a trace has no rate, every packet read for the queue was scheduled
+		double intended = replay_file[0] ? (stats->nr_pkts + stats->nr_never_sent)/seconds : ((double) nr_scheduled)/nr_queues/seconds;
+		double offered = stats->nr_pkts/seconds;
+		printf("queue %u: intended %.0f pps, offered %.0f pps (%.2f%%), %lu never sent, %lu caught up, %lu schedule shifts (avg %.1f us)\n",
+			i, intended, offered, intended > 0 ? 100.0 * offered/intended : 0,
+			stats->nr_never_sent, stats->nr_caught_up, stats->nr_shifts,
+			stats->nr_shifts ? (stats->shift_sum/((double) stats->nr_shifts))/TICKS_PER_US : 0
+		);
+	}
+}
+
+// Print the packets and the throughput of each port and of all ports
+void print_port_stats() {
+	uint64_t total_tx = 0, total_rx = 0, total_obytes = 0, total_ibytes = 0;
+	double seconds = run_seconds();
+
+	printf("\nPort Stats:\n");
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		uint64_t nr_tx = 0, nr_rx = 0;
+		for(uint32_t i = p * nr_queues_per_port; i < (p + 1) * nr_queues_per_port; i++) {
+			nr_tx += tx_stats[i].nr_pkts;
+			nr_rx += rx_stats[i].nr_pkts;
+		}
+
+		struct rte_eth_stats eth_stats = {};
+		rte_eth_stats_get(ports[p].portid, &eth_stats);
+		printf("port %u: %lu packets sent (%.3f Gbps), %lu packets received (%.3f Gbps)\n",
+			ports[p].portid,
+			nr_tx, (eth_stats.obytes * 8)/(seconds * 1000000000),
+			nr_rx, (eth_stats.ibytes * 8)/(seconds * 1000000000)
+		);
+
+		total_tx += nr_tx;
+		total_rx += nr_rx;
+		total_obytes += eth_stats.obytes;
+		total_ibytes += eth_stats.ibytes;
+	}
+
+	printf("all ports: %lu packets sent (%.3f Gbps), %lu packets received (%.3f Gbps)\n",
+		total_tx, (total_obytes * 8)/(seconds * 1000000000),
+		total_rx, (total_ibytes * 8)/(seconds * 1000000000)
+	);
+}
+
+// Print the flows, the counters and the latency of each backend (merged from every queue)
+void print_backend_stats() {
+	char title[MAXSTRLEN];
+	histogram_t *total = hist_create("latency_backend");
+
+	printf("\nBackend Stats:\n");
+	for(uint32_t b = 0; b < nr_backends; b++) {
+		backend_t *backend = &backends[b];
+		uint64_t nr_tx = 0, nr_rx = 0;
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			nr_tx += backend_tx_pkts[i][b];
+			nr_rx += backend_rx_pkts[i][b];
+		}
+
+		uint32_t addr = backend->dst_ipv4_addr;
+		printf("backend %u (%u.%u.%u.%u:%u, port %u, weight %.2f): %u flows, %lu packets sent, %lu packets received (%.2f%% lost)\n",
+			b, addr & 0xff, (addr >> 8) & 0xff, (addr >> 16) & 0xff, (addr >> 24) & 0xff, backend->dst_udp_port,
+			ports[backend->port].portid, backend->weight, backend->nr_flows, nr_tx, nr_rx,
+			nr_tx ? 100.0 * (nr_tx - RTE_MIN(nr_rx, nr_tx))/nr_tx : 0
+		);
+	}
+
+	for(uint32_t b = 0; b < nr_backends; b++) {
+		hist_reset(total);
+		for(uint32_t i = 0; i < nr_queues; i++) {
+			hist_merge(total, &backend_hists[i][b]);
+		}
+		snprintf(title, sizeof(title), "RTT Latency (backend %u)", b);
+		print_latency_summary(title, total);
+	}
+
+	rte_free(total);
+}
+
+// Print the throughput achieved in closed-loop
+void print_closed_loop_stats() {
+	uint64_t nr_responses = 0;
+	uint64_t nr_timeouts = 0;
+	uint64_t nr_stale = 0;
+	uint64_t nr_completion_drops = 0;
+	uint64_t nr_completion_skips = 0;
+	for(uint32_t i = 0; i < nr_queues; i++) {
+		nr_responses += latency_hists[i][0].count;
+		nr_timeouts += tx_stats[i].nr_timeouts;
+		nr_stale += tx_stats[i].nr_stale;
+		nr_completion_drops += rx_stats[i].nr_completion_drops;
+		nr_completion_skips += rx_stats[i].nr_completion_skips;
+	}
+
+	printf("\nClosed-loop Stats:\n");
+	printf("outstanding per flow: %u\n", outstanding);
+	printf("achieved throughput: %.0f pps\n", ((double) nr_responses)/phases[0].duration);
+	printf("timed out requests: %lu\n", nr_timeouts);
+	printf("responses after the timeout of their request (ignored): %lu\n", nr_stale);
+	printf("completions lost in a full completion ring: %lu\n", nr_completion_drops);
+	printf("responses received by another port than the one of their flow (timed out): %lu\n", nr_completion_skips);
+}
+
 // Process the config file
+// Parse a dotted ipv4 address
+static uint32_t parse_ipv4_addr(const char *entry) {
+	uint8_t b3, b2, b1, b0;
+	sscanf(entry, "%hhd.%hhd.%hhd.%hhd", &b3, &b2, &b1, &b0);
+
+	return IPV4_ADDR(b3, b2, b1, b0);
+}
+
+// Parse a dotted ipv4 address or a range of addresses FIRST-LAST (and its number of addresses)
+static uint32_t parse_ipv4_range(const char *entry, uint32_t *count) {
+	uint32_t first = parse_ipv4_addr(entry);
+	*count = 1;
+
+	const char *sep = strchr(entry, '-');
+	if(sep) {
+		uint32_t last = parse_ipv4_addr(sep + 1);
+		if(rte_be_to_cpu_32(last) < rte_be_to_cpu_32(first) || rte_be_to_cpu_32(last) - rte_be_to_cpu_32(first) == UINT32_MAX) {
+			rte_exit(EXIT_FAILURE, "Invalid address range %s.\n", entry);
+		}
+		*count = rte_be_to_cpu_32(last) - rte_be_to_cpu_32(first) + 1;
+	}
+
+	return first;
+}
+
+// Parse a UDP port or a range of ports FIRST-LAST (and its number of ports)
+static uint16_t parse_udp_range(const char *entry, uint32_t *count) {
+	uint32_t first = 0, last = 0;
+	int n = sscanf(entry, "%u-%u", &first, &last);
+	if(n < 1 || first == 0 || first > UINT16_MAX || (n == 2 && (last < first || last > UINT16_MAX))) {
+		rte_exit(EXIT_FAILURE, "Invalid UDP port range %s.\n", entry);
+	}
+	*count = (n == 2) ? last - first + 1 : 1;
+
+	return first;
+}
+
 void process_config_file(char *cfg_file) {
 	// open the file
 	struct rte_cfgfile *file = rte_cfgfile_load(cfg_file, 0);
@@ -284,24 +1662,24 @@ void process_config_file(char *cfg_file) {
 	// load ipv4 addresses
 	entry = (char*) rte_cfgfile_get_entry(file, "ipv4", "src");
 	if(entry) {
-		uint8_t b3, b2, b1, b0;
-		sscanf(entry, "%hhd.%hhd.%hhd.%hhd", &b3, &b2, &b1, &b0);
-		src_ipv4_addr = IPV4_ADDR(b3, b2, b1, b0);
+		src_ipv4_addr = parse_ipv4_range(entry, &nr_src_ipv4_addrs);
 	}
 	entry = (char*) rte_cfgfile_get_entry(file, "ipv4", "dst");
 	if(entry) {
-		uint8_t b3, b2, b1, b0;
-		sscanf(entry, "%hhd.%hhd.%hhd.%hhd", &b3, &b2, &b1, &b0);
-		dst_ipv4_addr = IPV4_ADDR(b3, b2, b1, b0);
+		dst_ipv4_addr = parse_ipv4_addr(entry);
 	}
 
-	// load UDP destination port
+	// load UDP destination port and source ports
 	entry = (char*) rte_cfgfile_get_entry(file, "udp", "dst");
 	if(entry) {
 		uint16_t port;
 		sscanf(entry, "%hu", &port);
 		dst_udp_port = port;
 	}
+	entry = (char*) rte_cfgfile_get_entry(file, "udp", "src");
+	if(entry) {
+		src_udp_port = parse_udp_range(entry, &nr_src_udp_ports);
+	}
 
 	// local server info
 	entry = (char*) rte_cfgfile_get_entry(file, "server", "nr_servers");
@@ -311,6 +1689,125 @@ void process_config_file(char *cfg_file) {
 		nr_servers = n;
 	}
 
+	// load the lcore map (-m takes precedence)
+	entry = (char*) rte_cfgfile_get_entry(file, "lcores", "map");
+	if(entry && !lcore_map_spec[0]) {
+		snprintf(lcore_map_spec, sizeof(lcore_map_spec), "%s", entry);
+	}
+
+	// load the ports (the sections above are the defaults of every port)
+	char section[MAXSTRLEN];
+	nr_ports = rte_cfgfile_num_sections(file, "port", 4);
+	if(nr_ports > RTE_MAX_ETHPORTS) {
+		rte_exit(EXIT_FAILURE, "Too many ports in %s.\n", cfg_file);
+	}
+	for(uint32_t p = 0; p < nr_ports; p++) {
+		port_t *port = &ports[p];
+		snprintf(section, sizeof(section), "port%u", p);
+		if(!rte_cfgfile_has_section(file, section)) {
+			rte_exit(EXIT_FAILURE, "Missing section [%s] in %s.\n", section, cfg_file);
+		}
+
+		port->portid = p;
+		port->src_eth_addr = src_eth_addr;
+		port->dst_eth_addr = dst_eth_addr;
+		port->src_ipv4_addr = src_ipv4_addr;
+		port->nr_src_ipv4_addrs = nr_src_ipv4_addrs;
+		port->dst_ipv4_addr = dst_ipv4_addr;
+		port->src_udp_port = src_udp_port;
+		port->nr_src_udp_ports = nr_src_udp_ports;
+		port->dst_udp_port = dst_udp_port;
+
+		entry = (char*) rte_cfgfile_get_entry(file, section, "id");
+		if(entry) {
+			port->portid = process_int_arg(entry);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "ethernet_src");
+		if(entry) {
+			rte_ether_unformat_addr((const char*) entry, &port->src_eth_addr);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "ethernet_dst");
+		if(entry) {
+			rte_ether_unformat_addr((const char*) entry, &port->dst_eth_addr);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "ipv4_src");
+		if(entry) {
+			port->src_ipv4_addr = parse_ipv4_range(entry, &port->nr_src_ipv4_addrs);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "ipv4_dst");
+		if(entry) {
+			port->dst_ipv4_addr = parse_ipv4_addr(entry);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "udp_dst");
+		if(entry) {
+			uint16_t udp_port;
+			sscanf(entry, "%hu", &udp_port);
+			port->dst_udp_port = udp_port;
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "udp_src");
+		if(entry) {
+			port->src_udp_port = parse_udp_range(entry, &port->nr_src_udp_ports);
+		}
+
+		for(uint32_t q = 0; q < p; q++) {
+			if(ports[q].portid == port->portid) {
+				rte_exit(EXIT_FAILURE, "Port %u is used twice in %s.\n", port->portid, cfg_file);
+			}
+		}
+	}
+
+	// load the backends (the destination of the port by default)
+	nr_backends = rte_cfgfile_num_sections(file, "backend", 7);
+	if(nr_backends > MAX_BACKENDS) {
+		rte_exit(EXIT_FAILURE, "Too many backends in %s (up to %u).\n", cfg_file, MAX_BACKENDS);
+	}
+	for(uint32_t b = 0; b < nr_backends; b++) {
+		backend_t *backend = &backends[b];
+		snprintf(section, sizeof(section), "backend%u", b);
+		if(!rte_cfgfile_has_section(file, section)) {
+			rte_exit(EXIT_FAILURE, "Missing section [%s] in %s.\n", section, cfg_file);
+		}
+
+		backend->port = 0;
+		entry = (char*) rte_cfgfile_get_entry(file, section, "port");
+		if(entry) {
+			backend->port = process_int_arg(entry);
+		}
+		if(backend->port >= RTE_MAX(nr_ports, 1)) {
+			rte_exit(EXIT_FAILURE, "The backend %u is on an unknown port in %s.\n", b, cfg_file);
+		}
+
+		backend->weight = 1;
+		backend->dst_eth_addr = nr_ports ? ports[backend->port].dst_eth_addr : dst_eth_addr;
+		backend->dst_ipv4_addr = nr_ports ? ports[backend->port].dst_ipv4_addr : dst_ipv4_addr;
+		backend->dst_udp_port = nr_ports ? ports[backend->port].dst_udp_port : dst_udp_port;
+
+		entry = (char*) rte_cfgfile_get_entry(file, section, "weight");
+		if(entry) {
+			backend->weight = strtod(entry, NULL);
+			if(backend->weight <= 0) {
+				rte_exit(EXIT_FAILURE, "The weight of the backend %u should be positive in %s.\n", b, cfg_file);
+			}
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "ethernet_dst");
+		if(entry) {
+			rte_ether_unformat_addr((const char*) entry, &backend->dst_eth_addr);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "ipv4_dst");
+		if(entry) {
+			backend->dst_ipv4_addr = parse_ipv4_addr(entry);
+		}
+		entry = (char*) rte_cfgfile_get_entry(file, section, "udp_dst");
+		if(entry) {
+			uint16_t udp_port;
+			sscanf(entry, "%hu", &udp_port);
+			backend->dst_udp_port = udp_port;
+		}
+	}
+
+	// the latency and the counters are kept per backend only when the flows are spread over several backends
+	backend_stats = (nr_backends > 1);
+
 	// close the file
 	rte_cfgfile_close(file);
 }
@@ -321,3 +1818,11 @@ inline void fill_payload_pkt(struct rte_mbuf *pkt, uint32_t idx, uint64_t value)
 
 	((uint64_t*) payload)[idx] = value;
 }
+
+
+// Read the data from packet payload properly
+inline uint64_t read_payload_pkt(struct rte_mbuf *pkt, uint32_t idx) {
+	uint8_t *payload = (uint8_t*) rte_pktmbuf_mtod_offset(pkt, uint8_t*, sizeof(struct rte_ether_hdr) + sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_udp_hdr));
+
+	return ((uint64_t*) payload)[idx];
+}
\ No newline at end of file
@@ -20,67 +20,280 @@
 #include <rte_malloc.h>
 #include <rte_cfgfile.h>
 #include <rte_mempool.h>
+#include <rte_mbuf_dyn.h>
+
+#include "dist_util.h"
+#include "stats_util.h"
+#include "output_format.h"
+#include "udp_util.h"
 
 // Constants
 #define EPSILON						0.00001
 #define MAXSTRLEN					128
-#define UNIFORM_VALUE				0
-#define EXPONENTIAL_VALUE			1
+#define BURST_RECORDS				4096
+#define CLOSED_LOOP_TIMEOUT_US		10000
+#define MAX_PHASES					64
+#define START_DELAY_US				1000
+#define POOL_SAMPLE_US				1000
+#define MAX_SIZE_CLASSES			64
+#define LATE_THRESHOLD_US			5
+#define SEQ_WINDOW					64
+#define LATE_DROP					0
+#define LATE_CATCHUP				1
+#define LATE_SHIFT					2
+#define ROLE_NONE					0
+#define ROLE_TX						1
+#define ROLE_RX						2
+#define ROLE_RX_RING				3
+#define ROLE_REPLAY					4
 #define IPV4_ADDR(a, b, c, d)		(((d & 0xff) << 24) | ((c & 0xff) << 16) | ((b & 0xff) << 8) | (a & 0xff))
 
 typedef struct lcore_parameters {
 	uint8_t qid;
 	uint16_t portid;
-	uint64_t nr_elements;
+	uint16_t port_qid;
 } __rte_cache_aligned lcore_param;
 
+// Role of a worker core and the queues it serves (a core has a single role)
+typedef struct lcore_role_s {
+	uint8_t role;
+	uint32_t nr_queues;
+	uint32_t qids[RTE_MAX_LCORE];
+} lcore_role_t;
+
+// Frame sizes sent with their weights (a single class for a fixed size)
+typedef struct size_model_s {
+	char name[MAXSTRLEN];
+	uint32_t nr_classes;
+	size_class_t classes[MAX_SIZE_CLASSES];
+	double weights[MAX_SIZE_CLASSES];
+} size_model_t;
+
+// Phase of the rate schedule (the phases run back to back)
+typedef struct phase_s {
+	uint64_t rate;
+	uint64_t duration;
+	uint64_t warmup;
+	int distribution;
+	size_model_t sizes;
+
+	// size class sampler of each queue (NULL for a fixed size)
+	flow_dist_t *size_dists[RTE_MAX_LCORE];
+
+	// absolute limits of the phase (set when the run starts)
+	uint64_t start_tsc;
+	uint64_t warmup_tsc;
+	uint64_t end_tsc;
+} phase_t;
+
+typedef struct tx_statistics {
+	uint64_t nr_pkts;
+	uint64_t nr_bytes;
+	uint64_t nr_bursts;
+	uint64_t nr_never_sent;
+	uint64_t nr_caught_up;
+	uint64_t nr_shifts;
+	uint64_t shift_sum;
+	uint64_t nr_timeouts;
+	uint64_t nr_stale;
+	uint64_t pacing_error_sum;
+	uint64_t pacing_error_max;
+} __rte_cache_aligned tx_stats_t;
+
+typedef struct rx_statistics {
+	uint64_t nr_pkts;
+	uint64_t nr_bytes;
+	uint64_t nr_empty;
+	uint64_t nr_unknown;
+	uint64_t nr_misrouted;
+	uint64_t nr_completion_drops;
+	uint64_t nr_completion_skips;
+	uint64_t ring_delay_sum;
+	uint64_t ring_delay_max;
+	int64_t hw_error_sum;
+	uint64_t hw_nr_samples;
+} __rte_cache_aligned rx_stats_t;
+
+// Sequence numbers received from a flow (the last SEQ_WINDOW ones in a bitmap, 32 bytes)
+typedef struct seq_state_s {
+	uint64_t window;			// bit i: next - 1 - i received
+	uint32_t next;				// highest sequence number received + 1
+	uint32_t nr_received;
+	uint32_t nr_lost;			// skipped and not received yet
+	uint32_t nr_duplicated;
+	uint32_t nr_reordered;		// received after a higher one (in the window)
+	uint32_t nr_old;			// received after a higher one (out of the window, duplicated or reordered)
+} seq_state_t;
+
 typedef struct timestamp_node_t {
 	uint64_t flow_id;
 	uint64_t thread_id;
-	uint64_t ack_dup;
-	uint64_t ack_empty;
 	uint64_t timestamp_rx;
 	uint64_t timestamp_tx;
-	uint64_t nr_never_sent;
+	uint64_t hw_timestamp_rx;
+	uint64_t hw_timestamp_tx;
 } node_t;
 
+// Everything the RX core needs to record the incoming packets of a queue
+typedef struct rx_context_s {
+	uint32_t qid;
+	port_t *port;
+	rx_stats_t *stats;
+	uint32_t phase;
+	histogram_t *hists;
+	histogram_t *warmup_hists;
+	histogram_t *hw_hists;
+	histogram_t *backend_hists;
+	uint64_t *backend_rx_pkts;
+	node_t *incoming;
+	uint64_t *incoming_idx;
+	struct rte_ring **completion_rings;
+} rx_context_t;
+
 extern uint64_t rate;
-extern uint16_t portid;
 extern uint64_t duration;
 extern uint64_t nr_flows;
 extern uint64_t nr_queues;
 extern uint16_t nr_servers;
-extern uint32_t frame_size;
 extern uint32_t min_lcores;
-extern uint32_t udp_payload_size;
+extern uint64_t burst_window_ns;
+extern uint8_t late_policy;
+extern uint64_t late_threshold_us;
+
+extern phase_t phases[MAX_PHASES];
+extern uint32_t nr_phases;
 
 extern uint64_t TICKS_PER_US;
-extern uint16_t **flow_indexes_array;
-extern uint64_t **interarrival_array;
 
 extern uint16_t dst_udp_port;
+extern uint16_t src_udp_port;
+extern uint32_t nr_src_udp_ports;
 extern uint32_t dst_ipv4_addr;
 extern uint32_t src_ipv4_addr;
+extern uint32_t nr_src_ipv4_addrs;
 extern struct rte_ether_addr dst_eth_addr;
 extern struct rte_ether_addr src_eth_addr;
 
 extern volatile uint8_t quit_rx;
 extern volatile uint8_t quit_tx;
 extern volatile uint8_t quit_rx_ring;
+extern lcore_param lcore_params[RTE_MAX_LCORE];
+extern lcore_role_t lcore_roles[RTE_MAX_LCORE];
+extern uint8_t lcore_map_set;
+
+extern tx_stats_t tx_stats[RTE_MAX_LCORE];
+extern rx_stats_t rx_stats[RTE_MAX_LCORE];
+extern uint64_t report_interval_ms;
+extern uint8_t rx_rtc_mode;
+extern uint32_t outstanding;
+extern uint8_t soft_demux;
+extern struct rte_ring *completion_rings[RTE_MAX_LCORE][RTE_MAX_LCORE];
+
+extern uint8_t capture_mode;
+extern uint8_t binary_output;
+extern char output_file[MAXSTRLEN];
+extern histogram_t *latency_hists[RTE_MAX_LCORE];
+extern histogram_t *warmup_hists[RTE_MAX_LCORE];
+extern histogram_t *hw_latency_hists[RTE_MAX_LCORE];
+extern histogram_t *send_late_hists[RTE_MAX_LCORE];
+extern histogram_t *send_early_hists[RTE_MAX_LCORE];
+extern histogram_t *never_sent_hists[RTE_MAX_LCORE];
+extern uint8_t hw_timestamps;
+extern int hw_rx_ts_offset;
+extern uint64_t hw_rx_ts_flag;
+extern int hw_tx_ts_offset;
+extern uint64_t hw_tx_ts_flag;
+
+extern uint8_t backend_stats;
+extern histogram_t *backend_hists[RTE_MAX_LCORE];
+extern uint64_t *backend_tx_pkts[RTE_MAX_LCORE];
+extern uint64_t *backend_rx_pkts[RTE_MAX_LCORE];
+
+extern uint32_t *tx_seqs[RTE_MAX_LCORE];
+extern seq_state_t *seq_states[RTE_MAX_LCORE];
 
 extern node_t **incoming_array;
 extern uint64_t *incoming_idx_array;
 
+uint32_t min_frame_size();
 void clean_heap();
+void start_phases(uint64_t t0);
 void wait_timeout();
+void print_rx_stats();
+void print_tx_stats();
+void print_closed_loop_stats();
+void print_port_stats();
+void print_backend_stats();
+void print_pool_stats();
+void print_lcore_map();
 void print_dpdk_stats();
 void print_stats_output();
+void write_binary_output(uint32_t qid);
 void process_config_file();
-double sample(double lambda);
 void allocate_incoming_nodes();
-void create_interarrival_array();
-void create_flow_indexes_array();
+void create_latency_hists();
+void create_size_dists();
+void create_seq_states();
+void print_seq_stats();
+void merge_demux_hists();
+void init_rx_context(rx_context_t *ctx, uint32_t qid);
 int app_parse_args(int argc, char **argv);
 void fill_payload_pkt(struct rte_mbuf *pkt, uint32_t idx, uint64_t value);
+uint64_t read_payload_pkt(struct rte_mbuf *pkt, uint32_t idx);
+
+// Latency histograms of each RX core (one per phase, and also per queue of its port in the software demux)
+static inline uint32_t nr_hist_slots() {
+	return soft_demux ? nr_queues_per_port * nr_phases : nr_phases;
+}
+
+// Phase in which a packet was sent (packets arrive mostly in order, so the last phase is cached)
+static inline uint32_t phase_of(rx_context_t *ctx, uint64_t tsc) {
+	uint32_t p = ctx->phase;
+	while(unlikely(p + 1 < nr_phases && tsc >= phases[p + 1].start_tsc)) {
+		p++;
+	}
+	while(unlikely(p > 0 && tsc < phases[p].start_tsc)) {
+		p--;
+	}
+	ctx->phase = p;
+
+	return p;
+}
+
+// Account the sequence number of a packet of the flow (no allocation, a single state per flow)
+static inline void seq_record(seq_state_t *state, uint32_t seq) {
+	state->nr_received++;
+
+	int32_t ahead = (int32_t) (seq - state->next);
+	if(likely(ahead >= 0)) {
+		// the sequence numbers skipped are lost until they arrive
+		state->nr_lost += ahead;
+		state->window = (ahead + 1 < SEQ_WINDOW) ? (state->window << (ahead + 1)) | 1 : 1;
+		state->next = seq + 1;
+		return;
+	}
+
+	uint32_t age = state->next - 1 - seq;
+	if(unlikely(age >= SEQ_WINDOW)) {
+		state->nr_old++;
+	} else if(state->window & (1ULL << age)) {
+		state->nr_duplicated++;
+	} else {
+		state->window |= (1ULL << age);
+		state->nr_lost--;
+		state->nr_reordered++;
+	}
+}
+
+// Convert a TSC timestamp into the NIC clock of the port
+static inline uint64_t tsc_to_nic(port_t *port, uint64_t tsc) {
+	const hw_clock_t *clock = &port->hw_clock[port->hw_clock_cur];
+	return clock->nic0 + (int64_t) (((int64_t) (tsc - clock->tsc0))/clock->ticks_per_nic);
+}
+
+// Convert an interval of the NIC clock of the port into ticks
+static inline uint64_t nic_to_ticks(port_t *port, uint64_t nic) {
+	return (uint64_t) (nic * port->hw_clock[port->hw_clock_cur].ticks_per_nic);
+}
 
 #endif // __UTIL_H__